@@ -0,0 +1,329 @@
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <netinet/in.h>
+#include "batch_io.h"
+
+#ifdef __linux__
+#include <netinet/udp.h>
+
+// Older headers predate the UDP offload options
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+// Ancillary data carrying a segment size, suitably aligned
+union segment_cmsg {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+};
+#endif
+
+// Prepare an empty batch for a socket
+void send_batch_init(struct send_batch *b, int sockfd, struct io_stats *stats) {
+    b->count = 0;
+    b->sockfd = sockfd;
+    b->gso = false;
+    b->stats = stats;
+}
+
+// Queue one datagram, flushing first if the batch is full
+int send_batch_add(struct send_batch *b, const struct sockaddr_in *dest,
+                   const void *hdr, size_t hdr_len, const void *payload, size_t payload_len) {
+    if (b->count == IO_BATCH_MAX && send_batch_flush(b) < 0) {
+        return -1;
+    }
+
+    int i = b->count++;
+    b->iov[i][0].iov_base = (void *)hdr;
+    b->iov[i][0].iov_len = hdr_len;
+    b->iov[i][1].iov_base = NULL;
+    b->iov[i][1].iov_len = 0;
+    b->iov_count[i] = 1;
+    if (payload && payload_len > 0) {
+        b->iov[i][1].iov_base = (void *)payload;
+        b->iov[i][1].iov_len = payload_len;
+        b->iov_count[i] = 2;
+    }
+    b->len[i] = hdr_len + payload_len;
+    b->dest[i] = *dest;
+    return 0;
+}
+
+#ifdef __linux__
+
+static bool same_dest(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+// Turn the datagrams queued from index first on into messages, recording
+// the first datagram of each. With GSO, a run to one peer in which every
+// datagram is the size of the first, bar a shorter last one, becomes a
+// single message whose segment size tells the kernel where to cut.
+static int build_messages(struct send_batch *b, int first, struct mmsghdr *msgs,
+                          union segment_cmsg *ctrl, int *msg_first) {
+    int num_msgs = 0;
+    int i = first;
+    while (i < b->count) {
+        int run = 1;
+        uint32_t bytes = b->len[i];
+        while (b->gso && i + run < b->count && run < IO_GSO_MAX_SEGS &&
+               b->len[i + run] <= b->len[i] && bytes + b->len[i + run] <= IO_GSO_MAX_BYTES &&
+               same_dest(&b->dest[i + run], &b->dest[i])) {
+            bytes += b->len[i + run];
+            if (b->len[i + run++] < b->len[i]) break;
+        }
+
+        struct msghdr *mh = &msgs[num_msgs].msg_hdr;
+        memset(&msgs[num_msgs], 0, sizeof(msgs[num_msgs]));
+        mh->msg_name = &b->dest[i];
+        mh->msg_namelen = sizeof(b->dest[i]);
+        mh->msg_iov = b->iov[i];
+        mh->msg_iovlen = run > 1 ? 2 * run : b->iov_count[i];
+        if (run > 1) {
+            mh->msg_control = ctrl[num_msgs].buf;
+            mh->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            struct cmsghdr *cm = CMSG_FIRSTHDR(mh);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment_size = b->len[i];
+            memcpy(CMSG_DATA(cm), &segment_size, sizeof(segment_size));
+        }
+        msg_first[num_msgs++] = i;
+        i += run;
+    }
+    return num_msgs;
+}
+
+// Send everything queued with as few sendmmsg calls as possible
+int send_batch_flush(struct send_batch *b) {
+    struct mmsghdr msgs[IO_BATCH_MAX];
+    union segment_cmsg ctrl[IO_BATCH_MAX];
+    int msg_first[IO_BATCH_MAX + 1];
+
+    int next = 0;
+    while (next < b->count) {
+        int num_msgs = build_messages(b, next, msgs, ctrl, msg_first);
+        msg_first[num_msgs] = b->count;
+
+        int ret = sendmmsg(b->sockfd, msgs, num_msgs, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == ENOBUFS) {
+                // Socket buffer full: the protocol treats what is left as lost
+                break;
+            }
+            if (b->gso && (errno == EIO || errno == EINVAL)) {
+                // The device cannot checksum or segment for us: send the
+                // rest, and everything after, as plain datagrams
+                b->gso = false;
+                continue;
+            }
+            perror("sendmmsg failed");
+            b->count = 0;
+            return -1;
+        }
+
+        if (b->stats) {
+            b->stats->send_calls++;
+            b->stats->packets_sent += msg_first[ret] - next;
+            for (int m = 0; m < ret; m++) {
+                int segments = msg_first[m + 1] - msg_first[m];
+                if (segments > 1) {
+                    b->stats->gso_sends++;
+                    b->stats->gso_packets += segments;
+                }
+            }
+        }
+        next = msg_first[ret];
+    }
+    b->count = 0;
+    return 0;
+}
+
+// Setting the socket-wide segment size to 0 changes nothing, but only
+// succeeds on a kernel that knows UDP_SEGMENT
+bool send_batch_enable_gso(struct send_batch *b) {
+    int off = 0;
+    b->gso = setsockopt(b->sockfd, SOL_UDP, UDP_SEGMENT, &off, sizeof(off)) == 0;
+    return b->gso;
+}
+
+bool recv_batch_enable_gro(struct recv_batch *b, int sockfd) {
+    int on = 1;
+    b->gro = setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+    return b->gro;
+}
+
+// Size the kernel cut a coalesced buffer at, or 0 if it holds one datagram
+static uint32_t gro_segment_size(struct msghdr *mh) {
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(mh); cm; cm = CMSG_NXTHDR(mh, cm)) {
+        if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+            int size;
+            memcpy(&size, CMSG_DATA(cm), sizeof(size));
+            return size > 0 ? (uint32_t)size : 0;
+        }
+    }
+    return 0;
+}
+
+// Drain ready datagrams with one recvmmsg
+static int recv_batch_common(int sockfd, struct recv_batch *b, int flags) {
+    struct mmsghdr msgs[IO_BATCH_MAX];
+    struct iovec iov[IO_BATCH_MAX];
+    struct sockaddr_in src[IO_BATCH_MAX];
+    union segment_cmsg ctrl[IO_GRO_BUFS];
+
+    // Without GRO every buffer holds one datagram; with it, a few large
+    // buffers each take a whole coalesced run
+    int num_bufs = b->gro ? IO_GRO_BUFS : IO_BATCH_MAX;
+    memset(msgs, 0, sizeof(msgs[0]) * num_bufs);
+    for (int i = 0; i < num_bufs; i++) {
+        if (b->gro) {
+            iov[i].iov_base = b->buffers.gro[i];
+            iov[i].iov_len = IO_GRO_BUF_SIZE;
+            msgs[i].msg_hdr.msg_control = ctrl[i].buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i].buf);
+        } else {
+            iov[i].iov_base = &b->buffers.pkts[i];
+            iov[i].iov_len = sizeof(b->buffers.pkts[i]);
+        }
+        msgs[i].msg_hdr.msg_name = &src[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(src[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    b->count = 0;
+    int ret;
+    do {
+        ret = recvmmsg(sockfd, msgs, num_bufs, flags, NULL);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    if (b->stats) {
+        b->stats->recv_calls++;
+    }
+
+    // Split coalesced buffers at the segment size, skipping runts so
+    // callers only see whole headers. A datagram the kernel had to cut
+    // short is dropped whole, rather than passed on as a shorter segment.
+    // A peer segmenting into more than IO_GSO_MAX_SEGS could overrun
+    // pkts[]; the excess is dropped.
+    for (int i = 0; i < ret; i++) {
+        uint8_t *buf = iov[i].iov_base;
+        uint32_t len = msgs[i].msg_len;
+        if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            if (b->stats) {
+                b->stats->truncated++;
+            }
+            continue;
+        }
+        uint32_t segment = b->gro ? gro_segment_size(&msgs[i].msg_hdr) : 0;
+        if (segment == 0) segment = len;
+
+        uint32_t segments = 0;
+        uint32_t off = 0;
+        do {
+            uint32_t seg_len = len - off < segment ? len - off : segment;
+            segments++;
+            if (seg_len >= SHAM_HEADER_SIZE && b->count < IO_RECV_MAX) {
+                b->pkts[b->count] = (struct sham_packet *)(buf + off);
+                b->src[b->count] = src[i];
+                b->len[b->count++] = seg_len;
+            }
+            off += seg_len;
+        } while (off < len);
+        if (b->stats) {
+            b->stats->packets_received += segments;
+            if (segments > 1) {
+                b->stats->gro_buffers++;
+                b->stats->gro_packets += segments;
+            }
+        }
+    }
+    return b->count;
+}
+
+#else
+
+// Portable fallback: one sendto per datagram
+int send_batch_flush(struct send_batch *b) {
+    for (int i = 0; i < b->count; i++) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &b->dest[i];
+        msg.msg_namelen = sizeof(b->dest[i]);
+        msg.msg_iov = b->iov[i];
+        msg.msg_iovlen = b->iov_count[i];
+        if (sendmsg(b->sockfd, &msg, 0) < 0 && errno != EAGAIN && errno != ENOBUFS) {
+            perror("sendmsg failed");
+            b->count = 0;
+            return -1;
+        }
+        if (b->stats) {
+            b->stats->send_calls++;
+            b->stats->packets_sent++;
+        }
+    }
+    b->count = 0;
+    return 0;
+}
+
+// UDP segmentation offloads are Linux-only
+bool send_batch_enable_gso(struct send_batch *b) {
+    b->gso = false;
+    return false;
+}
+
+bool recv_batch_enable_gro(struct recv_batch *b, int sockfd) {
+    b->gro = false;
+    return false;
+}
+
+// Portable fallback: one recvfrom per datagram until the socket is empty
+static int recv_batch_common(int sockfd, struct recv_batch *b, int flags) {
+    b->count = 0;
+    while (b->count < IO_BATCH_MAX) {
+        struct sham_packet *pkt = &b->buffers.pkts[b->count];
+        socklen_t addr_len = sizeof(b->src[b->count]);
+        ssize_t len = recvfrom(sockfd, pkt, sizeof(*pkt),
+                               b->count == 0 ? flags : MSG_DONTWAIT,
+                               (struct sockaddr *)&b->src[b->count], &addr_len);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return b->count > 0 ? b->count : -1;
+        }
+        if (b->stats) {
+            b->stats->recv_calls++;
+            b->stats->packets_received++;
+        }
+        if (len >= (ssize_t)SHAM_HEADER_SIZE) {
+            b->pkts[b->count] = pkt;
+            b->len[b->count++] = len;
+        }
+    }
+    return b->count;
+}
+
+#endif
+
+void recv_batch_init(struct recv_batch *b, struct io_stats *stats) {
+    b->count = 0;
+    b->gro = false;
+    b->stats = stats;
+}
+
+// Drain ready datagrams without blocking
+int recv_batch_drain(int sockfd, struct recv_batch *b) {
+    return recv_batch_common(sockfd, b, MSG_DONTWAIT);
+}
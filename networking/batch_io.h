@@ -0,0 +1,91 @@
+#ifndef BATCH_IO_H
+#define BATCH_IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include "sham.h"
+
+// Batch Constants
+#define IO_BATCH_MAX 64            // Datagrams per sendmmsg/recvmmsg call
+#define IO_GSO_MAX_SEGS 64         // Datagrams the kernel segments out of one send
+#define IO_GSO_MAX_BYTES 65507     // Largest UDP payload, which a segmented send must fit in
+#define IO_GRO_BUFS 8              // Coalesced receive buffers per recvmmsg call
+#define IO_GRO_BUF_SIZE 65536      // Room for one coalesced run of datagrams
+#define IO_RECV_MAX (IO_GRO_BUFS * IO_GSO_MAX_SEGS)   // Datagrams one receive can yield
+
+// I/O Statistics: datagrams moved and the syscalls it took
+struct io_stats {
+    uint64_t packets_sent;
+    uint64_t send_calls;
+    uint64_t packets_received;
+    uint64_t recv_calls;
+    uint64_t gso_sends;            // Sends the kernel split into several datagrams
+    uint64_t gso_packets;          // ...and the datagrams they carried
+    uint64_t gro_buffers;          // Receive buffers holding several coalesced datagrams
+    uint64_t gro_packets;          // ...and the datagrams they held
+    uint64_t truncated;            // Datagrams dropped for not fitting a receive buffer
+};
+
+// Send Batch: datagrams queued for one sendmmsg. Each datagram is a header
+// plus an optional separate payload, gathered by the kernel. The iovec
+// pairs are contiguous, so with segmentation offload a run of datagrams to
+// one peer goes out as a single message the kernel cuts back up (UDP GSO).
+struct send_batch {
+    struct iovec iov[IO_BATCH_MAX][2];
+    int iov_count[IO_BATCH_MAX];
+    uint32_t len[IO_BATCH_MAX];    // Datagram length including the header
+    struct sockaddr_in dest[IO_BATCH_MAX];
+    int count;
+    int sockfd;
+    bool gso;                      // Send runs of equal-sized datagrams as one message
+    struct io_stats *stats;
+};
+
+// Receive Batch: datagrams drained by one recvmmsg. With receive offload
+// (UDP GRO) the kernel hands over runs of datagrams from one peer
+// coalesced into a buffer; they are split back out, so pkts[] points into
+// the buffers and a single call can yield up to IO_RECV_MAX datagrams.
+struct recv_batch {
+    union {
+        struct sham_packet pkts[IO_BATCH_MAX];
+        uint8_t gro[IO_GRO_BUFS][IO_GRO_BUF_SIZE];
+    } buffers;
+    struct sham_packet *pkts[IO_RECV_MAX];
+    struct sockaddr_in src[IO_RECV_MAX];
+    uint32_t len[IO_RECV_MAX];     // Datagram length including the header
+    int count;
+    bool gro;                      // Buffers may hold coalesced datagrams
+    struct io_stats *stats;
+};
+
+void send_batch_init(struct send_batch *b, int sockfd, struct io_stats *stats);
+
+// Queue one datagram; the batch flushes itself when full. The buffers must
+// stay valid until the next flush.
+int send_batch_add(struct send_batch *b, const struct sockaddr_in *dest,
+                   const void *hdr, size_t hdr_len, const void *payload, size_t payload_len);
+
+// Send everything queued; returns 0 or -1 on a hard error
+int send_batch_flush(struct send_batch *b);
+
+// Turn on segmentation offload; false, leaving it off, if the kernel lacks
+// it. Should a device later refuse a segmented send, the batch falls back
+// to plain datagrams by itself.
+bool send_batch_enable_gso(struct send_batch *b);
+
+void recv_batch_init(struct recv_batch *b, struct io_stats *stats);
+
+// Accept coalesced datagrams on sockfd; false, leaving it off, if the
+// kernel lacks receive offload
+bool recv_batch_enable_gro(struct recv_batch *b, int sockfd);
+
+// Drain ready datagrams without blocking: up to IO_BATCH_MAX, or IO_RECV_MAX
+// with receive offload. Returns the number received (0 if none were ready) or -1 on error. Datagrams shorter
+// than a header, or too long for a buffer, are discarded.
+int recv_batch_drain(int sockfd, struct recv_batch *b);
+
+#endif // BATCH_IO_H
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "sham.h"
+#include "batch_io.h"
+
+// I/O throughput benchmark: moves S.H.A.M.-sized datagrams across loopback
+// with one syscall per datagram, with sendmmsg/recvmmsg batches, and with
+// batches plus UDP segmentation offload (GSO/GRO), and reports packets per
+// syscall and packet rate for each.
+
+#define BENCH_CHUNK 256            // Datagrams sent before draining the receiver
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Create the receiving socket on an ephemeral loopback port
+static int open_receiver(struct sockaddr_in *addr) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        exit(1);
+    }
+
+    int rcvbuf = 8 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr->sin_port = 0;
+    if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        perror("bind");
+        exit(1);
+    }
+
+    socklen_t len = sizeof(*addr);
+    getsockname(fd, (struct sockaddr *)addr, &len);
+    return fd;
+}
+
+// One sendto and one recvfrom per datagram
+static void run_single(int tx, int rx, struct sockaddr_in *dest, struct sham_packet *pkt,
+                       uint32_t payload, long packets, struct io_stats *stats) {
+    struct sham_packet in;
+    long sent = 0;
+
+    while (sent < packets) {
+        long chunk = packets - sent < BENCH_CHUNK ? packets - sent : BENCH_CHUNK;
+        for (long i = 0; i < chunk; i++) {
+            pkt->header.seq_num = (uint32_t)(sent + i);
+            sendto(tx, pkt, SHAM_HEADER_SIZE + payload, 0, (struct sockaddr *)dest, sizeof(*dest));
+            stats->send_calls++;
+            stats->packets_sent++;
+        }
+        sent += chunk;
+
+        while (recvfrom(rx, &in, sizeof(in), MSG_DONTWAIT, NULL, NULL) >= 0) {
+            stats->recv_calls++;
+            stats->packets_received++;
+        }
+        stats->recv_calls++; // The call that found the socket empty
+    }
+}
+
+// Whole chunks through sendmmsg, drained with recvmmsg. With offload the
+// kernel segments and coalesces runs; GRO stays on for the receiving
+// socket afterwards, so that mode runs last.
+static void run_batched(int tx, int rx, struct sockaddr_in *dest, struct sham_packet *pkts,
+                        uint32_t payload, long packets, bool offload, struct io_stats *stats) {
+    static struct recv_batch rb;
+    struct send_batch sb;
+    long sent = 0;
+
+    send_batch_init(&sb, tx, stats);
+    recv_batch_init(&rb, stats);
+    if (offload && (!send_batch_enable_gso(&sb) || !recv_batch_enable_gro(&rb, rx))) {
+        fprintf(stderr, "UDP GSO/GRO unavailable; offload runs as plain batches\n");
+    }
+
+    while (sent < packets) {
+        long chunk = packets - sent < BENCH_CHUNK ? packets - sent : BENCH_CHUNK;
+        for (long i = 0; i < chunk; i++) {
+            struct sham_packet *pkt = &pkts[i % IO_BATCH_MAX];
+            pkt->header.seq_num = (uint32_t)(sent + i);
+            send_batch_add(&sb, dest, &pkt->header, SHAM_HEADER_SIZE, pkt->data, payload);
+        }
+        send_batch_flush(&sb);
+        sent += chunk;
+
+        while (recv_batch_drain(rx, &rb) > 0) {
+        }
+        stats->recv_calls++; // The call that found the socket empty
+    }
+}
+
+static void report(const char *mode, struct io_stats *stats, double elapsed, uint32_t payload) {
+    double pps = stats->packets_received / elapsed;
+    printf("%-8s %10llu %10llu %10llu %10.1f %10.1f %10.3f %10.2f\n", mode,
+           (unsigned long long)stats->packets_received,
+           (unsigned long long)stats->send_calls, (unsigned long long)stats->recv_calls,
+           (double)stats->packets_sent / stats->send_calls,
+           (double)stats->packets_received / stats->recv_calls,
+           pps / 1e6, pps * payload * 8 / 1e9);
+}
+
+int main(int argc, char *argv[]) {
+    long packets = argc > 1 ? atol(argv[1]) : 200000;
+    uint32_t payload = argc > 2 ? (uint32_t)atoi(argv[2]) : SHAM_DATA_SIZE;
+    if (packets <= 0 || payload > SHAM_MAX_DATA_SIZE) {
+        fprintf(stderr, "Usage: %s [packets] [payload_bytes <= %d]\n", argv[0], SHAM_MAX_DATA_SIZE);
+        return 1;
+    }
+
+    struct sockaddr_in dest;
+    int rx = open_receiver(&dest);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    int sndbuf = 8 * 1024 * 1024;
+    setsockopt(tx, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    static struct sham_packet pkts[IO_BATCH_MAX];
+    memset(pkts, 0xab, sizeof(pkts));
+
+    printf("%ld datagrams of %u + %zu bytes over loopback\n\n", packets, payload, SHAM_HEADER_SIZE);
+    printf("%-8s %10s %10s %10s %10s %10s %10s %10s\n", "mode", "received", "send_calls",
+           "recv_calls", "pkt/send", "pkt/recv", "Mpps", "Gbit/s");
+
+    struct io_stats single = {0}, batched = {0}, offloaded = {0};
+    double start = now_seconds();
+    run_single(tx, rx, &dest, &pkts[0], payload, packets, &single);
+    report("single", &single, now_seconds() - start, payload);
+
+    start = now_seconds();
+    run_batched(tx, rx, &dest, pkts, payload, packets, false, &batched);
+    report("batched", &batched, now_seconds() - start, payload);
+
+    start = now_seconds();
+    run_batched(tx, rx, &dest, pkts, payload, packets, true, &offloaded);
+    report("offload", &offloaded, now_seconds() - start, payload);
+
+    close(tx);
+    close(rx);
+    return 0;
+}
@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <libgen.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+// Transfer benchmark: runs real transfers over loopback across a matrix of
+// file sizes, loss rates, round-trip times, segment sizes and congestion
+// controllers, and records goodput, completion time, retransmissions, CPU
+// time and peak RSS for each, as a table and as CSV and JSON for comparing
+// one version with another. Loss is the server's own; a round-trip time
+// puts the impair proxy in between.
+
+#define BENCH_MAX_VALUES 16        // Values per swept parameter
+#define BENCH_RUN_TIMEOUT_S 120    // A transfer taking longer counts as failed
+#define BENCH_BASE_PORT 9400       // Runs use ports from here up
+#define BENCH_STARTUP_MS 200       // Time given the server and proxy to bind
+
+struct sweep {
+    const char *values[BENCH_MAX_VALUES];
+    int count;
+};
+
+// One transfer and what it cost
+struct result {
+    unsigned long long size;
+    double loss;
+    double rtt_ms;
+    const char *mss;               // "auto" probes the path
+    const char *cc;
+    int run;
+    int ok;                        // Arrived intact in time
+    double seconds;
+    double goodput_mbps;
+    unsigned long retransmissions;
+    unsigned long segments;
+    double client_cpu_s;
+    double server_cpu_s;
+    long client_rss_kb;
+    long server_rss_kb;
+};
+
+static char bin_dir[PATH_MAX];
+static char work_dir[] = "/tmp/bench_xfer.XXXXXX";
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+// Split a comma-separated list in place
+static void parse_sweep(struct sweep *s, char *list) {
+    s->count = 0;
+    for (char *tok = strtok(list, ","); tok && s->count < BENCH_MAX_VALUES; tok = strtok(NULL, ",")) {
+        s->values[s->count++] = tok;
+    }
+}
+
+// Bytes, with an optional K, M or G suffix
+static unsigned long long parse_size(const char *s) {
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'K': case 'k': return n << 10;
+    case 'M': case 'm': return n << 20;
+    case 'G': case 'g': return n << 30;
+    default: return n;
+    }
+}
+
+// Start a program from bin_dir in work_dir, its output going to out_path
+static pid_t spawn(char *const argv[], const char *out_path) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+    if (chdir(work_dir) < 0) _exit(127);
+    int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", bin_dir, argv[0]) >= (int)sizeof(path)) _exit(127);
+    execv(path, argv);
+    _exit(127);
+}
+
+// Wait for a child until deadline, killing it then; its resource usage
+// goes to ru. Returns its exit status, or -1 if it had to be killed.
+static int reap(pid_t pid, double deadline, struct rusage *ru) {
+    int status;
+    for (;;) {
+        pid_t r = wait4(pid, &status, WNOHANG, ru);
+        if (r == pid) {
+            return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        }
+        if (r < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (now_seconds() > deadline) {
+            kill(pid, SIGKILL);
+            wait4(pid, &status, 0, ru);
+            return -1;
+        }
+        sleep_ms(5);
+    }
+}
+
+static double cpu_seconds(const struct rusage *ru) {
+    return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6 +
+           ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+}
+
+// The input file for a size, made once from random bytes
+static int make_input(unsigned long long size, char *path, size_t path_len) {
+    snprintf(path, path_len, "%s/input_%llu.bin", work_dir, size);
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        return 0;
+    }
+    FILE *in = fopen("/dev/urandom", "rb");
+    FILE *out = fopen(path, "wb");
+    if (!in || !out) {
+        perror("Failed to create input file");
+        if (in) fclose(in);
+        if (out) fclose(out);
+        return -1;
+    }
+    static char buf[1 << 16];
+    for (unsigned long long left = size; left > 0;) {
+        size_t n = left < sizeof(buf) ? left : sizeof(buf);
+        if (fread(buf, 1, n, in) != n || fwrite(buf, 1, n, out) != n) break;
+        left -= n;
+    }
+    fclose(in);
+    fclose(out);
+    return 0;
+}
+
+static int files_equal(const char *a, const char *b) {
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    int equal = fa && fb;
+    static char ba[1 << 16], bb[1 << 16];
+    while (equal) {
+        size_t na = fread(ba, 1, sizeof(ba), fa);
+        size_t nb = fread(bb, 1, sizeof(bb), fb);
+        equal = na == nb && memcmp(ba, bb, na) == 0;
+        if (na == 0) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return equal;
+}
+
+// Pull the retransmission count and segment size from the client's summary
+static void parse_client_output(const char *path, struct result *r) {
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    char line[512];
+    unsigned long mss = 0;
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "Retransmissions: %lu", &r->retransmissions);
+        sscanf(line, "Segment size: %lu", &mss);
+    }
+    fclose(f);
+    if (mss > 0) {
+        r->segments = (r->size + mss - 1) / mss;
+    }
+}
+
+static void run_one(struct result *r, int port, char **extra, int num_extra) {
+    char input[PATH_MAX], output[PATH_MAX], client_log[PATH_MAX];
+    char port_arg[16], server_port_arg[16], loss_arg[32], delay_arg[32], mss_arg[32], cc_arg[32];
+    if (make_input(r->size, input, sizeof(input)) < 0) {
+        return;
+    }
+    snprintf(output, sizeof(output), "%s/received_file", work_dir);
+    snprintf(client_log, sizeof(client_log), "%s/client.out", work_dir);
+    unlink(output);
+
+    // Server, and the proxy in front of it if there is a round trip to add
+    int server_port = port;
+    int client_port = port;
+    snprintf(server_port_arg, sizeof(server_port_arg), "%d", server_port);
+    snprintf(loss_arg, sizeof(loss_arg), "%g", r->loss);
+    char *server_argv[] = { "server", server_port_arg, loss_arg, NULL };
+    pid_t server = spawn(server_argv, "server.out");
+    pid_t proxy = -1;
+    if (r->rtt_ms > 0) {
+        client_port = port + 1;
+        snprintf(port_arg, sizeof(port_arg), "%d", client_port);
+        snprintf(delay_arg, sizeof(delay_arg), "--delay=%g", r->rtt_ms / 2);
+        char *proxy_argv[] = { "impair", port_arg, "127.0.0.1", server_port_arg, delay_arg, NULL };
+        proxy = spawn(proxy_argv, "impair.out");
+    }
+    sleep_ms(BENCH_STARTUP_MS);
+
+    // Client, with the row's settings and whatever else was asked for
+    snprintf(port_arg, sizeof(port_arg), "%d", client_port);
+    snprintf(cc_arg, sizeof(cc_arg), "--cc=%s", r->cc);
+    char *client_argv[16 + BENCH_MAX_VALUES];
+    int n = 0;
+    client_argv[n++] = "client";
+    client_argv[n++] = "127.0.0.1";
+    client_argv[n++] = port_arg;
+    client_argv[n++] = input;
+    client_argv[n++] = "output.bin";
+    client_argv[n++] = cc_arg;
+    if (strcmp(r->mss, "auto") != 0) {
+        snprintf(mss_arg, sizeof(mss_arg), "--mss=%s", r->mss);
+        client_argv[n++] = mss_arg;
+    }
+    for (int i = 0; i < num_extra && i < BENCH_MAX_VALUES; i++) {
+        client_argv[n++] = extra[i];
+    }
+    client_argv[n] = NULL;
+
+    struct rusage client_ru, server_ru;
+    memset(&client_ru, 0, sizeof(client_ru));
+    memset(&server_ru, 0, sizeof(server_ru));
+    double start = now_seconds();
+    double deadline = start + BENCH_RUN_TIMEOUT_S;
+    pid_t client = spawn(client_argv, "client.out");
+    int client_status = reap(client, deadline, &client_ru);
+    r->seconds = now_seconds() - start;
+    int server_status = reap(server, deadline + 5, &server_ru);
+    if (proxy > 0) {
+        struct rusage proxy_ru;
+        kill(proxy, SIGINT);
+        reap(proxy, now_seconds() + 5, &proxy_ru);
+    }
+
+    r->ok = client_status == 0 && server_status == 0 && files_equal(input, output);
+    r->goodput_mbps = r->seconds > 0 ? r->size * 8 / r->seconds / 1e6 : 0;
+    r->client_cpu_s = cpu_seconds(&client_ru);
+    r->server_cpu_s = cpu_seconds(&server_ru);
+    r->client_rss_kb = client_ru.ru_maxrss;
+    r->server_rss_kb = server_ru.ru_maxrss;
+    parse_client_output(client_log, r);
+}
+
+static double retx_ratio(const struct result *r) {
+    return r->segments ? (double)r->retransmissions / r->segments : 0.0;
+}
+
+static void write_csv(FILE *f, const char *label, const struct result *results, int count) {
+    fprintf(f, "label,size_bytes,loss,rtt_ms,mss,cc,run,ok,seconds,goodput_mbps,retransmissions,"
+               "segments,retx_ratio,client_cpu_s,server_cpu_s,client_rss_kb,server_rss_kb\n");
+    for (int i = 0; i < count; i++) {
+        const struct result *r = &results[i];
+        fprintf(f, "%s,%llu,%g,%g,%s,%s,%d,%d,%.4f,%.2f,%lu,%lu,%.4f,%.4f,%.4f,%ld,%ld\n",
+                label, r->size, r->loss, r->rtt_ms, r->mss, r->cc, r->run, r->ok, r->seconds,
+                r->goodput_mbps, r->retransmissions, r->segments, retx_ratio(r),
+                r->client_cpu_s, r->server_cpu_s, r->client_rss_kb, r->server_rss_kb);
+    }
+}
+
+static void write_json(FILE *f, const char *label, const struct result *results, int count) {
+    fprintf(f, "{\n  \"label\": \"%s\",\n  \"runs\": [\n", label);
+    for (int i = 0; i < count; i++) {
+        const struct result *r = &results[i];
+        fprintf(f, "    {\"size_bytes\": %llu, \"loss\": %g, \"rtt_ms\": %g, \"mss\": \"%s\", \"cc\": \"%s\", "
+                   "\"run\": %d, \"ok\": %s, \"seconds\": %.4f, \"goodput_mbps\": %.2f, "
+                   "\"retransmissions\": %lu, \"segments\": %lu, \"retx_ratio\": %.4f, "
+                   "\"client_cpu_s\": %.4f, \"server_cpu_s\": %.4f, "
+                   "\"client_rss_kb\": %ld, \"server_rss_kb\": %ld}%s\n",
+                r->size, r->loss, r->rtt_ms, r->mss, r->cc, r->run, r->ok ? "true" : "false",
+                r->seconds, r->goodput_mbps, r->retransmissions, r->segments, retx_ratio(r),
+                r->client_cpu_s, r->server_cpu_s, r->client_rss_kb, r->server_rss_kb,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+static int write_file(const char *path, const char *label, const struct result *results, int count,
+                      void (*writer)(FILE *, const char *, const struct result *, int)) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    writer(f, label, results, count);
+    fclose(f);
+    printf("Wrote %s\n", path);
+    return 0;
+}
+
+// Inputs, received files and program output all live in one flat directory
+static void remove_work_dir(void) {
+    DIR *d = opendir(work_dir);
+    if (d) {
+        struct dirent *e;
+        char path[PATH_MAX];
+        while ((e = readdir(d)) != NULL) {
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+            snprintf(path, sizeof(path), "%s/%s", work_dir, e->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    rmdir(work_dir);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] [-- client options]\n", prog);
+    fprintf(stderr, "  --sizes=LIST   File sizes, with K, M or G suffixes (default 1M,16M)\n");
+    fprintf(stderr, "  --loss=LIST    Server loss rates (default 0,0.02)\n");
+    fprintf(stderr, "  --rtt=LIST     Round-trip times in ms, through the impair proxy (default 0,20)\n");
+    fprintf(stderr, "  --mss=LIST     Segment sizes, or auto to probe the path (default 1024,auto)\n");
+    fprintf(stderr, "  --cc=LIST      Congestion control algorithms (default cubic)\n");
+    fprintf(stderr, "  --runs=N       Repetitions of each combination (default 1)\n");
+    fprintf(stderr, "  --label=NAME   Name for this build in the results (default current)\n");
+    fprintf(stderr, "  --csv=FILE     Write the results as CSV\n");
+    fprintf(stderr, "  --json=FILE    Write the results as JSON\n");
+    fprintf(stderr, "  --port=N       First port to use (default %d)\n", BENCH_BASE_PORT);
+    fprintf(stderr, "Anything after -- is passed to every client, e.g. -- --fec --compress=lz\n");
+}
+
+int main(int argc, char *argv[]) {
+    char sizes_list[256] = "1M,16M", loss_list[256] = "0,0.02", rtt_list[256] = "0,20";
+    char mss_list[256] = "1024,auto", cc_list[256] = "cubic";
+    const char *label = "current", *csv_path = NULL, *json_path = NULL;
+    int runs = 1, port = BENCH_BASE_PORT;
+    char **extra = NULL;
+    int num_extra = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--") == 0) {
+            extra = argv + i + 1;
+            num_extra = argc - i - 1;
+            break;
+        } else if (strncmp(a, "--sizes=", 8) == 0) {
+            snprintf(sizes_list, sizeof(sizes_list), "%s", a + 8);
+        } else if (strncmp(a, "--loss=", 7) == 0) {
+            snprintf(loss_list, sizeof(loss_list), "%s", a + 7);
+        } else if (strncmp(a, "--rtt=", 6) == 0) {
+            snprintf(rtt_list, sizeof(rtt_list), "%s", a + 6);
+        } else if (strncmp(a, "--mss=", 6) == 0) {
+            snprintf(mss_list, sizeof(mss_list), "%s", a + 6);
+        } else if (strncmp(a, "--cc=", 5) == 0) {
+            snprintf(cc_list, sizeof(cc_list), "%s", a + 5);
+        } else if (strncmp(a, "--runs=", 7) == 0) {
+            runs = atoi(a + 7);
+        } else if (strncmp(a, "--label=", 8) == 0) {
+            label = a + 8;
+        } else if (strncmp(a, "--csv=", 6) == 0) {
+            csv_path = a + 6;
+        } else if (strncmp(a, "--json=", 7) == 0) {
+            json_path = a + 7;
+        } else if (strncmp(a, "--port=", 7) == 0) {
+            port = atoi(a + 7);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (runs < 1 || num_extra > BENCH_MAX_VALUES) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct sweep sizes, losses, rtts, msses, ccs;
+    parse_sweep(&sizes, sizes_list);
+    parse_sweep(&losses, loss_list);
+    parse_sweep(&rtts, rtt_list);
+    parse_sweep(&msses, mss_list);
+    parse_sweep(&ccs, cc_list);
+
+    // The programs under test sit next to this one
+    char self[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len <= 0) {
+        perror("Failed to locate the benchmark");
+        return 1;
+    }
+    self[len] = '\0';
+    snprintf(bin_dir, sizeof(bin_dir), "%s", dirname(self));
+    if (!mkdtemp(work_dir)) {
+        perror("Failed to create a working directory");
+        return 1;
+    }
+
+    int total = sizes.count * losses.count * rtts.count * msses.count * ccs.count * runs;
+    struct result *results = calloc(total, sizeof(*results));
+    if (!results) {
+        perror("Failed to allocate results");
+        remove_work_dir();
+        return 1;
+    }
+
+    printf("%-10s %6s %6s %6s %6s %4s %4s %8s %9s %8s %9s %9s %9s %9s\n",
+           "size", "loss", "rtt", "mss", "cc", "run", "ok", "time(s)", "Mbit/s",
+           "retx", "cli-cpu", "srv-cpu", "cli-rss", "srv-rss");
+    int count = 0;
+    for (int s = 0; s < sizes.count; s++)
+    for (int l = 0; l < losses.count; l++)
+    for (int t = 0; t < rtts.count; t++)
+    for (int m = 0; m < msses.count; m++)
+    for (int c = 0; c < ccs.count; c++)
+    for (int run = 1; run <= runs; run++) {
+        struct result *r = &results[count];
+        r->size = parse_size(sizes.values[s]);
+        r->loss = atof(losses.values[l]);
+        r->rtt_ms = atof(rtts.values[t]);
+        r->mss = msses.values[m];
+        r->cc = ccs.values[c];
+        r->run = run;
+        run_one(r, port + 2 * count, extra, num_extra);
+        count++;
+
+        printf("%-10llu %6g %6g %6s %6s %4d %4s %8.3f %9.1f %7.2f%% %8.3fs %8.3fs %7ldKB %7ldKB\n",
+               r->size, r->loss, r->rtt_ms, r->mss, r->cc, r->run, r->ok ? "yes" : "NO",
+               r->seconds, r->goodput_mbps, retx_ratio(r) * 100, r->client_cpu_s, r->server_cpu_s,
+               r->client_rss_kb, r->server_rss_kb);
+        fflush(stdout);
+    }
+
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        failed += !results[i].ok;
+    }
+    printf("%d runs, %d failed\n", count, failed);
+    if (csv_path) write_file(csv_path, label, results, count, write_csv);
+    if (json_path) write_file(json_path, label, results, count, write_json);
+
+    free(results);
+    remove_work_dir();
+    return failed > 0 ? 1 : 0;
+}
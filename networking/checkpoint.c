@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+
+void checkpoint_path(const char *output_path, char *buf, size_t len) {
+    snprintf(buf, len, "%s%s", output_path, CKPT_SUFFIX);
+}
+
+bool checkpoint_load(const char *output_path, uint64_t transfer_id, uint64_t file_size,
+                     digest_alg_t alg, struct checkpoint *ckpt) {
+    char path[128];
+    checkpoint_path(output_path, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t n = read(fd, ckpt, sizeof(*ckpt));
+    close(fd);
+
+    // The partial file must still hold everything the checkpoint covers
+    struct stat st;
+    if (n != (ssize_t)sizeof(*ckpt) || stat(output_path, &st) < 0) {
+        return false;
+    }
+    return memcmp(ckpt->magic, CKPT_MAGIC, sizeof(ckpt->magic)) == 0 &&
+           ckpt->version == CKPT_VERSION && ckpt->transfer_id == transfer_id &&
+           ckpt->file_size == file_size && ckpt->digest_alg == (uint32_t)alg &&
+           ckpt->digest.alg == alg && ckpt->committed <= file_size &&
+           (uint64_t)st.st_size >= ckpt->committed;
+}
+
+int checkpoint_save(const char *output_path, int data_fd, uint64_t transfer_id, uint64_t file_size,
+                    uint64_t committed, const struct digest *digest) {
+    struct checkpoint ckpt;
+    char path[128], tmp_path[136];
+
+    // Data first: a checkpoint must never get ahead of the file
+    if (fdatasync(data_fd) < 0) {
+        perror("fdatasync");
+        return -1;
+    }
+
+    memset(&ckpt, 0, sizeof(ckpt));
+    memcpy(ckpt.magic, CKPT_MAGIC, sizeof(ckpt.magic));
+    ckpt.version = CKPT_VERSION;
+    ckpt.digest_alg = digest->alg;
+    ckpt.transfer_id = transfer_id;
+    ckpt.file_size = file_size;
+    ckpt.committed = committed;
+    ckpt.digest = *digest;
+
+    checkpoint_path(output_path, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Failed to write checkpoint");
+        return -1;
+    }
+    ssize_t n = write(fd, &ckpt, sizeof(ckpt));
+    if (n != (ssize_t)sizeof(ckpt) || fdatasync(fd) < 0) {
+        perror("Failed to write checkpoint");
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp_path, path) < 0) {
+        perror("Failed to write checkpoint");
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+void checkpoint_remove(const char *output_path) {
+    char path[128];
+    checkpoint_path(output_path, path, sizeof(path));
+    if (unlink(path) < 0 && errno != ENOENT) {
+        perror("Failed to remove checkpoint");
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "digest.h"
+
+// Checkpoint Constants
+#define CKPT_MAGIC "SHAMCKPT"
+#define CKPT_VERSION 1
+#define CKPT_INTERVAL_BYTES (64ULL * 1024 * 1024)   // Committed data between checkpoints
+#define CKPT_SUFFIX ".ckpt"
+
+// Transfer Checkpoint: what the receiver needs to pick up a resumable
+// transfer where an earlier connection left it. It is saved next to the
+// partial output file, only after the data it covers is on disk, so the
+// file always holds at least committed bytes of the transfer. The digest
+// state is the running digest of exactly those bytes, kept as raw memory:
+// a checkpoint is only read back by the same build of the server.
+struct checkpoint {
+    char magic[8];
+    uint32_t version;
+    uint32_t digest_alg;
+    uint64_t transfer_id;          // Chosen by the client, stable across reconnects
+    uint64_t file_size;
+    uint64_t committed;            // Bytes of the file already written
+    struct digest digest;          // Running digest of those bytes
+};
+
+// Name of the checkpoint kept for an output file
+void checkpoint_path(const char *output_path, char *buf, size_t len);
+
+// Load the checkpoint for an output file. Returns false if there is none,
+// or it is for another transfer, file size or digest.
+bool checkpoint_load(const char *output_path, uint64_t transfer_id, uint64_t file_size,
+                     digest_alg_t alg, struct checkpoint *ckpt);
+
+// Make the output file's data durable, then atomically replace the
+// checkpoint with one for committed bytes
+int checkpoint_save(const char *output_path, int data_fd, uint64_t transfer_id, uint64_t file_size,
+                    uint64_t committed, const struct digest *digest);
+
+// Delete the checkpoint once the transfer is complete
+void checkpoint_remove(const char *output_path);
+
+#endif // CHECKPOINT_H
@@ -6,11 +6,24 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
-#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <time.h>
 #include <stdarg.h>
+#include <poll.h>
+#include <sys/wait.h>
 #include "sham.h"
+#include "rtt.h"
+#include "congestion.h"
+#include "batch_io.h"
+#include "options.h"
+#include "digest.h"
+#include "reactor.h"
+#include "pacer.h"
+#include "compress.h"
+#include "fec.h"
 
 // Global variables
 static FILE *log_file = NULL;
@@ -18,11 +31,103 @@ static bool logging_enabled = false;
 static double loss_rate = 0.0;
 static bool chat_mode = false;
 
-// Sliding window
-static struct packet_window window[SHAM_WINDOW_SIZE];
-static uint32_t window_base = 0;
-static uint32_t next_seq_num = 0;
-static uint16_t peer_window = 65535;
+// Sliding window. Positions are 64-bit offsets into the sequence space,
+// so a transfer can run past 4 GB; only their low 32 bits go on the wire,
+// and what comes back is extended again with seq_extend().
+static struct packet_window window[SHAM_MAX_WINDOW];
+static uint64_t window_base = 0;
+static uint64_t next_seq_num = 0;
+static uint64_t data_start_seq = 0;
+static uint32_t peer_window = 65535;   // In bytes, already scaled
+static uint8_t peer_wscale = 0;        // Shift the server applies to its windows
+static uint64_t transfer_size = 0;     // Bytes this connection sends, announced in the SYN; 0 in chat mode
+
+// Parallel transfer (--streams): the file is cut into ranges, each sent on
+// its own connection by its own process. In a stream's process, stream
+// describes its range; otherwise num_streams in it is 0.
+static int num_streams = 1;
+static struct sham_stream_opt stream;
+
+// Resumable transfer (--resume): the server keeps a checkpoint of what it
+// has, and the SYN-ACK says where to carry on from
+static bool resume = false;
+static uint64_t resume_id = 0;         // Same for every run on an unchanged file
+static uint64_t resume_offset = 0;     // Bytes the server already holds
+
+// Segment size. The largest the path carries is found by probing before
+// the handshake, unless --mss fixes it; the server may grant less.
+static uint32_t mss = SHAM_DATA_SIZE;
+static uint32_t mss_limit = 0;         // --mss; 0 probes the path
+
+// Retransmission timeout, adapted from RTT samples
+static struct rtt_estimator rtt;
+
+// Congestion control; the loss response runs once per window of data
+static const struct cc_ops *cc_algorithm = NULL;
+
+// End-to-end digest, updated as each segment is first sent
+static digest_alg_t digest_alg = 0;
+static struct digest tx_digest;
+static uint8_t tx_digest_value[DIGEST_MAX_LENGTH];
+static size_t tx_digest_len = 0;
+
+// Payload compression (--compress), if the server accepts it. Each window
+// slot has room for one block, kept until the segment is acknowledged so
+// retransmissions resend the same bytes.
+static compress_alg_t compress_alg = COMPRESS_NONE;
+static struct compressor compressor;
+static uint8_t *compress_buffer = NULL;
+
+// Forward error correction (--fec), if the server accepts it: a parity
+// segment after each block of new data, sized to the loss rate
+static bool fec_enabled = false;
+static struct fec_encoder fec;
+static struct cc_state cc;
+static uint64_t recovery_point = 0;
+
+// Fast recovery (NewReno): entered on a SACK hole or SHAM_DUP_THRESH
+// duplicate ACKs, left once everything outstanding at entry is acknowledged.
+// Each duplicate ACK means a segment has left the network, so the window is
+// inflated by one segment per dupACK to keep the pipe full meanwhile. Before
+// the threshold the same allowance sends new data (limited transmit), so a
+// small window still produces enough dupACKs to avoid a timeout.
+static bool in_recovery = false;
+static uint32_t dup_acks = 0;
+static uint32_t recovery_inflation = 0;
+
+// Event loop: the socket, chat input and the next timer deadline
+static struct reactor reactor;
+
+// Batched datagram I/O, with UDP segmentation offload unless --no-offload
+static bool offload = true;
+static struct io_stats io_stats;
+static struct send_batch tx_batch;
+static struct recv_batch rx_batch;
+
+// Per-segment retransmission and persist deadlines. Segments whose timer
+// fires are collected by the callback and handled after the wheel turns.
+static struct timer_wheel timers;
+static struct packet_window *expired[SHAM_MAX_WINDOW];
+static int num_expired = 0;
+
+// Pacing: new segments wait for the token bucket, whose rate follows the
+// congestion controller; the pace timer wakes the loop once it refills
+static pace_mode_t pace_mode = PACE_BUCKET;
+static uint64_t pace_max_rate = 0;     // --rate, bytes per second; 0 for no cap
+static struct pacer pacer;
+static struct timer pace_timer;
+
+// Zero-window persist timer
+static struct timer persist_timer;
+static bool persist_due = false;
+static int persist_probes = 0;
+static uint32_t zero_window_probes = 0;
+
+// Transfer statistics
+static uint32_t timeout_retx_count = 0;
+static uint32_t sack_retx_count = 0;
+static uint32_t dupack_retx_count = 0;
+static uint32_t checksum_errors = 0;
 
 // Initialize logging
 void init_logging(const char *log_filename) {
@@ -82,8 +187,12 @@ bool is_timeout(struct timeval *sent_time, int timeout_ms) {
 // Send packet
 int send_packet(int sockfd, struct sockaddr_in *dest_addr, struct sham_packet *pkt, uint32_t data_len) {
     size_t total_len = SHAM_HEADER_SIZE + data_len;
+    sham_checksum_set(&pkt->header, pkt->data, data_len);
     ssize_t sent = sendto(sockfd, pkt, total_len, 0, 
                           (struct sockaddr*)dest_addr, sizeof(*dest_addr));
+    if (sent < 0 && (errno == EAGAIN || errno == ENOBUFS)) {
+        return 0; // Socket buffer full: treated as lost
+    }
     if (sent < 0) {
         perror("sendto failed");
         return -1;
@@ -91,27 +200,69 @@ int send_packet(int sockfd, struct sockaddr_in *dest_addr, struct sham_packet *p
     return 0;
 }
 
-// Receive packet with timeout
-int recv_packet_timeout(int sockfd, struct sham_packet *pkt, struct sockaddr_in *src_addr, 
-                       uint32_t *data_len, int timeout_ms) {
-    struct timeval tv;
-    tv.tv_sec = timeout_ms / 1000;
-    tv.tv_usec = (timeout_ms % 1000) * 1000;
-    
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(sockfd, &read_fds);
+// Queue a data segment on the send batch; it goes out at the next flush.
+// The kernel gathers the header from the window entry and the payload
+// straight from the file mapping, or from the segment's compressed block.
+// The pacer is charged what actually goes on the wire.
+int queue_segment(struct sockaddr_in *dest_addr, struct packet_window *entry) {
+    pacer_consume(&pacer, entry->payload_len);
+    sham_checksum_set(&entry->header, entry->payload, entry->payload_len);
+    return send_batch_add(&tx_batch, dest_addr, &entry->header, SHAM_HEADER_SIZE,
+                          entry->payload, entry->payload_len);
+}
+
+// Add a new segment to the FEC block; once the block is complete, or the
+// file ends, its parity goes out right behind it. Parity is paced like
+// data but takes no part in the window.
+int queue_parity(struct sockaddr_in *dest_addr, const struct packet_window *entry, bool last) {
+    uint32_t parity_len;
+    struct sham_packet *parity = fec_encode(&fec, &entry->header, entry->payload, entry->payload_len,
+                                            last, &parity_len);
+    if (!parity) return 0;
     
-    int ret = select(sockfd + 1, &read_fds, NULL, NULL, &tv);
-    if (ret <= 0) {
-        return 0; // Timeout or error
+    log_event("SND PARITY SEQ=%u LEN=%u", parity->header.seq_num, parity_len);
+    pacer_consume(&pacer, parity_len);
+    sham_checksum_set(&parity->header, parity->data, parity_len);
+    return send_batch_add(&tx_batch, dest_addr, parity, SHAM_HEADER_SIZE + parity_len, NULL, 0);
+}
+
+// Drop a datagram whose checksum does not match; whatever it carried is
+// recovered as if it had been lost
+bool packet_intact(const struct sham_packet *pkt, uint32_t data_len) {
+    if (sham_checksum_ok(pkt, data_len)) {
+        return true;
     }
+    checksum_errors++;
+    log_event("DROP CORRUPT SEQ=%u ACK=%u", pkt->header.seq_num, pkt->header.ack_num);
+    return false;
+}
+
+// Receive packet with timeout. The socket is non-blocking and
+// edge-triggered, so the reactor is only consulted once it is empty.
+// Corrupted datagrams are skipped.
+int recv_packet_timeout(int sockfd, struct sham_packet *pkt, struct sockaddr_in *src_addr, 
+                       uint32_t *data_len, int timeout_ms) {
+    uint64_t deadline = timer_now_ms() + timeout_ms;
+    ssize_t recv_len;
     
-    socklen_t addr_len = sizeof(*src_addr);
-    ssize_t recv_len = recvfrom(sockfd, pkt, SHAM_PACKET_SIZE, 0,
-                                (struct sockaddr*)src_addr, &addr_len);
-    if (recv_len < 0) {
-        return -1;
+    while (1) {
+        socklen_t addr_len = sizeof(*src_addr);
+        recv_len = recvfrom(sockfd, pkt, SHAM_PACKET_SIZE, 0,
+                            (struct sockaddr*)src_addr, &addr_len);
+        if (recv_len >= (ssize_t)SHAM_HEADER_SIZE && !packet_intact(pkt, recv_len - SHAM_HEADER_SIZE)) {
+            continue;
+        }
+        if (recv_len >= 0) {
+            break;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return -1;
+        }
+        if (timer_now_ms() >= deadline) {
+            return 0; // Timeout
+        }
+        reactor_set_deadline(&reactor, deadline);
+        reactor_wait(&reactor, -1);
     }
     
     if (recv_len < (ssize_t)SHAM_HEADER_SIZE) {
@@ -122,11 +273,84 @@ int recv_packet_timeout(int sockfd, struct sham_packet *pkt, struct sockaddr_in
     return 1;
 }
 
+// Path MTU discovery, ahead of the handshake: send a SHAM_PMTU probe
+// padded to each candidate size with fragmentation forbidden, and settle on
+// the largest one the server echoes. A size the local link cannot carry
+// fails at once with EMSGSIZE; one a router drops is simply never answered,
+// which costs at most SHAM_PMTU_ROUNDS waits. Nothing is in flight yet, so
+// a lost probe costs nothing else. Returns the segment size to ask for.
+uint32_t discover_path_mss(int sockfd, struct sockaddr_in *server_addr) {
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+    // Jumbo frames, then Ethernet; the default size fits anything smaller
+    static const uint32_t candidates[] = { SHAM_MTU_PAYLOAD(9000), SHAM_MTU_PAYLOAD(1500) };
+    const int num_candidates = sizeof(candidates) / sizeof(candidates[0]);
+    
+    // Set DF, and ignore any cached path MTU so stale entries cannot veto a size
+    int saved_mode, probe_mode = IP_PMTUDISC_PROBE;
+    socklen_t opt_len = sizeof(saved_mode);
+    if (getsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &saved_mode, &opt_len) < 0 ||
+        setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &probe_mode, sizeof(probe_mode)) < 0) {
+        return SHAM_DATA_SIZE;
+    }
+    
+    struct sham_packet pkt;
+    uint32_t best = SHAM_DATA_SIZE;
+    uint32_t ceiling = candidates[0];    // Largest size that may still get through
+    for (int round = 0; round < SHAM_PMTU_ROUNDS && best < ceiling; round++) {
+        for (int i = 0; i < num_candidates && candidates[i] > best; i++) {
+            if (candidates[i] > ceiling) continue;
+            
+            memset(&pkt, 0, SHAM_HEADER_SIZE + candidates[i]);
+            pkt.header.flags = SHAM_PMTU;
+            pkt.header.window_size = 65535;
+            sham_checksum_set(&pkt.header, pkt.data, candidates[i]);
+            log_event("SND PMTU PROBE LEN=%u", candidates[i]);
+            if (sendto(sockfd, &pkt, SHAM_HEADER_SIZE + candidates[i], 0,
+                       (struct sockaddr *)server_addr, sizeof(*server_addr)) < 0 && errno == EMSGSIZE) {
+                ceiling = i + 1 < num_candidates ? candidates[i + 1] : best;
+            }
+        }
+        
+        // Collect echoes until the largest size still possible is confirmed
+        uint64_t deadline = timer_now_ms() + SHAM_PMTU_WAIT_MS;
+        uint64_t now;
+        uint32_t data_len;
+        while (best < ceiling && (now = timer_now_ms()) < deadline &&
+               recv_packet_timeout(sockfd, &pkt, server_addr, &data_len, deadline - now) > 0) {
+            if ((pkt.header.flags & SHAM_PMTU) && pkt.header.ack_num > best &&
+                pkt.header.ack_num <= SHAM_MAX_DATA_SIZE) {
+                best = pkt.header.ack_num;
+                log_event("RCV PMTU ECHO LEN=%u", best);
+            }
+        }
+    }
+    
+    setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &saved_mode, sizeof(saved_mode));
+    return best;
+#else
+    return SHAM_DATA_SIZE;
+#endif
+}
+
 // Perform 3-way handshake (client side)
 int perform_handshake(int sockfd, struct sockaddr_in *server_addr) {
     struct sham_packet pkt;
     uint32_t data_len;
     
+    // Segment size to ask for; chat messages are short lines, so only a
+    // file transfer probes the path
+    uint16_t mss_wanted = SHAM_DATA_SIZE;
+    if (mss_limit > 0) {
+        mss_wanted = mss_limit;
+    } else if (!chat_mode) {
+        mss_wanted = discover_path_mss(sockfd, server_addr);
+    }
+    
+    // Parity carries a header of its own on top of a segment's worth of data
+    if (fec_enabled && mss_wanted > SHAM_FEC_MAX_MSS) {
+        mss_wanted = SHAM_FEC_MAX_MSS;
+    }
+    
     // Send SYN
     uint32_t initial_seq = 100;
     memset(&pkt, 0, sizeof(pkt));
@@ -134,13 +358,62 @@ int perform_handshake(int sockfd, struct sockaddr_in *server_addr) {
     pkt.header.flags = SHAM_SYN;
     pkt.header.window_size = 65535;
     
-    log_event("SND SYN SEQ=%u", initial_seq);
-    send_packet(sockfd, server_addr, &pkt, 0);
+    // Handshake options; the receiver preallocates the file from its size
+    uint32_t opt_len = 0;
+    if (transfer_size > 0) {
+        sham_opt_put(pkt.data, &opt_len, SHAM_DATA_SIZE, SHAM_OPT_FILE_SIZE,
+                     &transfer_size, sizeof(transfer_size));
+        uint8_t alg = digest_alg;
+        sham_opt_put(pkt.data, &opt_len, SHAM_DATA_SIZE, SHAM_OPT_DIGEST, &alg, sizeof(alg));
+    }
+    sham_opt_put(pkt.data, &opt_len, SHAM_DATA_SIZE, SHAM_OPT_MSS, &mss_wanted, sizeof(mss_wanted));
     
-    // Wait for SYN-ACK
-    if (recv_packet_timeout(sockfd, &pkt, server_addr, &data_len, SHAM_TIMEOUT_MS) <= 0) {
-        fprintf(stderr, "Timeout waiting for SYN-ACK\n");
-        return -1;
+    // Offer window scaling. The client receives no data, so its own
+    // windows need no scaling and it offers a shift of 0.
+    uint8_t wscale = 0;
+    sham_opt_put(pkt.data, &opt_len, SHAM_DATA_SIZE, SHAM_OPT_WSCALE, &wscale, sizeof(wscale));
+    if (stream.num_streams > 1) {
+        sham_opt_put(pkt.data, &opt_len, SHAM_DATA_SIZE, SHAM_OPT_STREAM, &stream, sizeof(stream));
+    }
+    if (resume) {
+        struct sham_resume_opt resume_req = { resume_id, 0 };
+        sham_opt_put(pkt.data, &opt_len, SHAM_DATA_SIZE, SHAM_OPT_RESUME, &resume_req, sizeof(resume_req));
+    }
+    if (compress_alg != COMPRESS_NONE && transfer_size > 0) {
+        uint8_t alg = compress_alg;
+        sham_opt_put(pkt.data, &opt_len, SHAM_DATA_SIZE, SHAM_OPT_COMPRESS, &alg, sizeof(alg));
+    }
+    if (fec_enabled && transfer_size > 0) {
+        uint8_t scheme = FEC_XOR;
+        sham_opt_put(pkt.data, &opt_len, SHAM_DATA_SIZE, SHAM_OPT_FEC, &scheme, sizeof(scheme));
+    }
+    
+    rtt_init(&rtt, SHAM_TIMEOUT_MS);
+    struct sham_packet syn = pkt;
+    struct timeval syn_time;
+    int attempts = 0;
+    
+    // Send SYN until a SYN-ACK arrives, backing off like any other
+    // retransmission; a busy server may drop the first one. Late echoes of
+    // path MTU probes are skipped.
+    while (1) {
+        log_event("SND SYN SEQ=%u", initial_seq);
+        gettimeofday(&syn_time, NULL);
+        send_packet(sockfd, server_addr, &syn, opt_len);
+        
+        int received;
+        while ((received = recv_packet_timeout(sockfd, &pkt, server_addr, &data_len, rtt.rto_ms)) > 0 &&
+               (pkt.header.flags & SHAM_PMTU)) {
+        }
+        if (received > 0) {
+            break;
+        }
+        if (++attempts >= SHAM_SYN_RETRIES) {
+            fprintf(stderr, "Timeout waiting for SYN-ACK\n");
+            return -1;
+        }
+        rtt_backoff(&rtt);
+        log_event("TIMEOUT SYN RTO=%ums", rtt.rto_ms);
     }
     
     if (!(pkt.header.flags & SHAM_SYN) || !(pkt.header.flags & SHAM_ACK)) {
@@ -150,8 +423,83 @@ int perform_handshake(int sockfd, struct sockaddr_in *server_addr) {
     
     uint32_t server_seq = pkt.header.seq_num;
     log_event("RCV SYN-ACK SEQ=%u ACK=%u", server_seq, pkt.header.ack_num);
+    
+    // A receiver that delays its ACKs says by how much, so the RTO allows
+    // for it
+    uint16_t ack_delay;
+    if (sham_opt_get(pkt.data, data_len, SHAM_OPT_ACK_DELAY, &ack_delay, sizeof(ack_delay))) {
+        rtt.ack_delay_ms = ack_delay;
+        log_event("RCV OPT ACK_DELAY=%ums", ack_delay);
+    }
+    
+    // The handshake gives the first RTT sample, before any data is in
+    // flight, unless the SYN had to be repeated (Karn's rule)
+    if (attempts == 0) {
+        rtt_sample(&rtt, elapsed_us(&syn_time));
+        log_event("RTT SAMPLE=%uus SRTT=%uus RTO=%ums", elapsed_us(&syn_time), rtt.srtt_us, rtt.rto_ms);
+    }
     peer_window = pkt.header.window_size;
     
+    // Segment at the size granted; it can only be lowered, since the
+    // receiver aligns its reassembly slots to it
+    uint16_t mss_granted;
+    mss = SHAM_DATA_SIZE;
+    if (sham_opt_get(pkt.data, data_len, SHAM_OPT_MSS, &mss_granted, sizeof(mss_granted)) &&
+        mss_granted > 0 && mss_granted <= mss_wanted) {
+        mss = mss_granted;
+        log_event("RCV OPT MSS=%u", mss);
+    }
+    
+    // Windows in later ACKs are scaled if the server answered the offer;
+    // the SYN-ACK's own window never is
+    peer_wscale = 0;
+    if (sham_opt_get(pkt.data, data_len, SHAM_OPT_WSCALE, &peer_wscale, sizeof(peer_wscale))) {
+        if (peer_wscale > SHAM_MAX_WSCALE) peer_wscale = SHAM_MAX_WSCALE;
+        log_event("RCV OPT WSCALE=%u", peer_wscale);
+    }
+    
+    // A stream must be accepted as one: a server that ignored the option
+    // would write the range to the start of a file of its own
+    struct sham_stream_opt stream_echo;
+    if (stream.num_streams > 1 &&
+        (!sham_opt_get(pkt.data, data_len, SHAM_OPT_STREAM, &stream_echo, sizeof(stream_echo)) ||
+         stream_echo.transfer_id != stream.transfer_id || stream_echo.index != stream.index)) {
+        fprintf(stderr, "Server did not accept the parallel stream\n");
+        return -1;
+    }
+    
+    // Skip whatever the server already holds of a resumed transfer
+    struct sham_resume_opt resume_reply;
+    resume_offset = 0;
+    if (resume && sham_opt_get(pkt.data, data_len, SHAM_OPT_RESUME, &resume_reply, sizeof(resume_reply)) &&
+        resume_reply.transfer_id == resume_id && resume_reply.offset <= transfer_size) {
+        resume_offset = resume_reply.offset;
+        log_event("RCV OPT RESUME OFFSET=%llu", (unsigned long long)resume_offset);
+    }
+    
+    // Compress only if the server echoed the algorithm it will decode
+    uint8_t compress_echo;
+    if (compress_alg != COMPRESS_NONE && transfer_size > 0) {
+        if (sham_opt_get(pkt.data, data_len, SHAM_OPT_COMPRESS, &compress_echo, sizeof(compress_echo)) &&
+            compress_echo == compress_alg) {
+            log_event("RCV OPT COMPRESS=%s", compress_name(compress_alg));
+        } else {
+            printf("Server does not support %s compression; sending uncompressed\n", compress_name(compress_alg));
+            compress_alg = COMPRESS_NONE;
+        }
+    }
+    
+    // Likewise send parity only if the server will use it
+    uint8_t fec_echo;
+    if (fec_enabled && transfer_size > 0) {
+        if (sham_opt_get(pkt.data, data_len, SHAM_OPT_FEC, &fec_echo, sizeof(fec_echo)) && fec_echo == FEC_XOR) {
+            log_event("RCV OPT FEC=%u", fec_echo);
+        } else {
+            printf("Server does not support FEC; sending without parity\n");
+            fec_enabled = false;
+        }
+    }
+    
     // Send ACK
     memset(&pkt, 0, sizeof(pkt));
     pkt.header.seq_num = initial_seq + 1;
@@ -164,98 +512,606 @@ int perform_handshake(int sockfd, struct sockaddr_in *server_addr) {
     
     next_seq_num = initial_seq + 1;
     window_base = initial_seq + 1;
+    data_start_seq = initial_seq + 1;
+    
+    return 0;
+}
+
+// Map a stream position to its window slot. Slots are keyed by absolute
+// segment number so an in-flight packet keeps its slot as window_base moves.
+int window_slot(uint64_t seq) {
+    return ((seq - data_start_seq) / mss) % SHAM_MAX_WINDOW;
+}
+
+// Retransmission timer expiry: queue the segment for the caller, which
+// resends everything that expired and backs off once
+void on_retransmit_timer(struct timer *t, void *ctx) {
+    expired[num_expired++] = TIMER_CONTAINER(t, struct packet_window, rto_timer);
+}
+
+// Restart a segment's retransmission timer after (re)sending it
+void arm_retransmit(struct packet_window *entry, uint64_t now) {
+    timer_arm(&timers, &entry->rto_timer, now + rtt.rto_ms);
+}
+
+// Mark in-flight segments covered by the SACK blocks of an ACK. Block
+// edges are extended from the wire like the cumulative ACK.
+void process_sack_blocks(struct sham_packet *ack_pkt, uint32_t data_len) {
+    if (!(ack_pkt->header.flags & SHAM_SACK)) return;
+    
+    struct sham_sack_block blocks[SHAM_MAX_SACK_BLOCKS];
+    int num_blocks = data_len / sizeof(struct sham_sack_block);
+    if (num_blocks > SHAM_MAX_SACK_BLOCKS) num_blocks = SHAM_MAX_SACK_BLOCKS;
+    memcpy(blocks, ack_pkt->data, num_blocks * sizeof(struct sham_sack_block));
+    
+    for (int b = 0; b < num_blocks; b++) {
+        log_event("RCV SACK %u-%u", blocks[b].start_seq, blocks[b].end_seq);
+        uint64_t start = seq_extend(window_base, blocks[b].start_seq);
+        uint64_t end = seq_extend(window_base, blocks[b].end_seq);
+        
+        for (uint64_t seq = window_base; seq < next_seq_num; seq += mss) {
+            struct packet_window *entry = &window[window_slot(seq)];
+            if (seq >= start && seq + entry->data_len <= end) {
+                entry->acked = true;
+                timer_cancel(&timers, &entry->rto_timer);
+            }
+        }
+    }
+}
+
+// Take an RTT sample from the newest segment a cumulative ACK covers.
+// Karn's rule: a segment that was retransmitted, or whose arrival was
+// already reported by SACK, gives an ambiguous sample and is skipped.
+uint32_t sample_rtt_on_ack(uint64_t ack_num) {
+    struct packet_window *newest = NULL;
+    for (uint64_t seq = window_base; seq < ack_num && seq < next_seq_num; seq += mss) {
+        newest = &window[window_slot(seq)];
+    }
+    
+    if (newest && newest->retries == 0 && !newest->fast_retx && !newest->acked) {
+        uint32_t sample_us = elapsed_us(&newest->send_time);
+        rtt_sample(&rtt, sample_us);
+        log_event("RTT SAMPLE=%uus SRTT=%uus RTO=%ums", sample_us, rtt.srtt_us, rtt.rto_ms);
+        return sample_us;
+    }
+    return 0;
+}
+
+// SACKed segments, or duplicate ACKs, above a hole before it is deemed
+// lost. With FEC the hole first waits for the rest of its block and the
+// parity that may rebuild it.
+uint32_t loss_threshold(void) {
+    return SHAM_DUP_THRESH + (fec_enabled ? fec.block : 0);
+}
+
+// Resend the segment at seq ahead of its timer, unless the receiver holds
+// it already or it has been resent this way before. Returns true if sent.
+bool fast_retransmit(struct sockaddr_in *server_addr, uint64_t seq, uint64_t now, const char *reason) {
+    if (seq >= next_seq_num) return false;
+    
+    struct packet_window *entry = &window[window_slot(seq)];
+    if (entry->acked || entry->fast_retx) return false;
+    
+    log_event("RETX DATA SEQ=%u LEN=%u (%s)", entry->header.seq_num, entry->data_len, reason);
+    queue_segment(server_addr, entry);
+    if (fec_enabled) {
+        fec_on_loss(&fec);
+    }
+    gettimeofday(&entry->send_time, NULL);
+    arm_retransmit(entry, now);
+    entry->fast_retx = true;
+    return true;
+}
+
+// Retransmit only the segments the receiver reports missing. A segment is
+// a hole once loss_threshold() segments above it have been SACKed; each hole
+// is resent once this way and falls back to the timer if that copy is lost.
+// Returns the number of segments retransmitted.
+int retransmit_sack_holes(struct sockaddr_in *server_addr, uint64_t now) {
+    if (next_seq_num <= window_base) return 0;
+    
+    int num_segments = (next_seq_num - window_base + mss - 1) / mss;
+    uint32_t threshold = loss_threshold();
+    uint32_t sacked_above = 0;
+    int resent = 0;
+    
+    // Walk from the top of the window down, counting SACKed segments above each one
+    for (int i = num_segments - 1; i >= 0; i--) {
+        uint64_t seq = window_base + (uint64_t)i * mss;
+        struct packet_window *entry = &window[window_slot(seq)];
+        
+        if (entry->acked) {
+            sacked_above++;
+            continue;
+        }
+        
+        if (sacked_above >= threshold && fast_retransmit(server_addr, seq, now, "SACK")) {
+            sack_retx_count++;
+            resent++;
+        }
+    }
+    return resent;
+}
+
+// Bytes that may still be put in flight: the smaller of the congestion
+// window (inflated during fast recovery) and the receiver's advertised
+// window, less what is outstanding
+uint32_t usable_window(void) {
+    uint32_t in_flight = next_seq_num - window_base;
+    uint32_t limit = cc.cwnd + recovery_inflation;
+    if (limit > cc.max_cwnd) limit = cc.max_cwnd;
+    if (limit > peer_window) limit = peer_window;
+    return in_flight < limit ? limit - in_flight : 0;
+}
+
+// Pacing timer expiry: nothing to do but let the send loop run again
+void on_pace_timer(struct timer *t, void *ctx) {
+}
+
+// Probe a closed receiver window. The window update that reopens it could be
+// lost, so with nothing in flight the sender probes on a backed-off timer
+// and gives up only if SHAM_MAX_RETRIES probes in a row go unanswered.
+void on_persist_timer(struct timer *t, void *ctx) {
+    persist_due = true;
+}
+
+int check_persist_timer(int sockfd, struct sockaddr_in *server_addr, uint64_t now) {
+    if (peer_window >= mss || next_seq_num != window_base) {
+        timer_cancel(&timers, &persist_timer);
+        persist_due = false;
+        return 0;
+    }
+    
+    if (!timer_pending(&persist_timer) && !persist_due) {
+        persist_probes = 0;
+        timer_arm(&timers, &persist_timer, now + rtt.rto_ms);
+        log_event("FLOW WIN CLOSED");
+        return 0;
+    }
+    
+    if (!persist_due) {
+        return 0;
+    }
+    persist_due = false;
+    if (persist_probes >= SHAM_MAX_RETRIES) {
+        fprintf(stderr, "Receiver window stayed closed\n");
+        return -1;
+    }
+    
+    struct sham_packet probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.header.seq_num = (uint32_t)next_seq_num;
+    probe.header.flags = SHAM_PROBE;
+    probe.header.window_size = 65535;
     
+    log_event("SND PROBE SEQ=%u", probe.header.seq_num);
+    send_packet(sockfd, server_addr, &probe, 0);
+    persist_probes++;
+    zero_window_probes++;
+    timer_arm(&timers, &persist_timer, now + ((uint64_t)rtt.rto_ms << (persist_probes < 6 ? persist_probes : 6)));
     return 0;
 }
 
-// Send file with sliding window
+// Loss detected without a timeout: reduce the window, once per window of
+// data, and repair holes in fast recovery until recovery_point is acknowledged
+void enter_recovery(void) {
+    if (window_base < recovery_point) return;
+    
+    cc_on_loss(&cc, next_seq_num - window_base);
+    recovery_point = next_seq_num;
+    in_recovery = true;
+    recovery_inflation = 0;
+    log_event("CC LOSS CWND=%u SSTHRESH=%u", cc.cwnd, cc.ssthresh);
+}
+
+void exit_recovery(void) {
+    in_recovery = false;
+    recovery_inflation = 0;
+    dup_acks = 0;
+}
+
+// Count duplicate ACKs and handle partial ACKs in fast recovery
+void track_recovery(struct sockaddr_in *server_addr, uint64_t ack_num, uint32_t acked_bytes, uint64_t now) {
+    if (acked_bytes > 0) {
+        dup_acks = 0;
+        if (!in_recovery) {
+            recovery_inflation = 0;
+            return;
+        }
+        
+        if (ack_num >= recovery_point) {
+            log_event("RECOVERY EXIT ACK=%u", (uint32_t)ack_num);
+            exit_recovery();
+            return;
+        }
+        
+        // Partial ACK: the next hole is at the new window base. Resend it
+        // right away and take back the inflation the ACK accounts for.
+        recovery_inflation = recovery_inflation > acked_bytes ? recovery_inflation - acked_bytes : 0;
+        if (fast_retransmit(server_addr, window_base, now, "partial ACK")) {
+            dupack_retx_count++;
+        }
+        return;
+    }
+    
+    // A duplicate only counts while data is outstanding
+    if (ack_num != window_base || next_seq_num == window_base) return;
+    
+    dup_acks++;
+    uint32_t threshold = loss_threshold();
+    if (in_recovery || dup_acks < threshold) {
+        recovery_inflation += mss;
+    } else if (dup_acks == threshold) {
+        log_event("DUPACK x%u ACK=%u", dup_acks, (uint32_t)ack_num);
+        if (fast_retransmit(server_addr, window_base, now, "dupACK")) {
+            dupack_retx_count++;
+        }
+        enter_recovery();
+        if (in_recovery) {
+            recovery_inflation = threshold * mss;
+        }
+    }
+}
+
+// Process one ACK: slide the window, feed RTT and congestion control,
+// update the peer's window, record SACK blocks and track duplicate ACKs
+void handle_ack(struct sockaddr_in *server_addr, struct sham_packet *ack_pkt, uint32_t ack_data_len, uint64_t now) {
+    if (!(ack_pkt->header.flags & SHAM_ACK) || (ack_pkt->header.flags & SHAM_PMTU)) return;
+    
+    log_event("RCV ACK=%u", ack_pkt->header.ack_num);
+    uint64_t ack_num = seq_extend(window_base, ack_pkt->header.ack_num);
+    
+    // The receiver rebuilt a segment from parity: a loss all the same
+    if (fec_enabled && (ack_pkt->header.flags & SHAM_FEC)) {
+        fec_on_loss(&fec);
+        fec.stats.rebuilt++;
+    }
+    
+    // Update window base (cumulative ACK); nothing beyond what was sent
+    // can be acknowledged
+    uint32_t acked_bytes = 0;
+    if (ack_num > window_base && ack_num <= next_seq_num) {
+        struct cc_ack ack_event;
+        ack_event.rtt_us = sample_rtt_on_ack(ack_num);
+        ack_event.acked_bytes = ack_num - window_base;
+        acked_bytes = ack_event.acked_bytes;
+        for (uint64_t seq = window_base; seq < ack_num; seq += mss) {
+            timer_cancel(&timers, &window[window_slot(seq)].rto_timer);
+        }
+        window_base = ack_num;
+        ack_event.bytes_in_flight = next_seq_num - window_base;
+        cc_on_ack(&cc, &ack_event);
+    }
+    
+    // Window is relative to the ACK; ignore it on stale, reordered ACKs
+    if (ack_num == window_base) {
+        peer_window = (uint32_t)ack_pkt->header.window_size << peer_wscale;
+        log_event("FLOW WIN UPDATE=%u", peer_window);
+    }
+    
+    process_sack_blocks(ack_pkt, ack_data_len);
+    if (ack_num == window_base) {
+        track_recovery(server_addr, ack_num, acked_bytes, now);
+    }
+}
+
+// Pacing rate and how the segments were spread out, flush by flush
+void print_pacing_stats(void) {
+    if (pacer.mode == PACE_OFF) {
+        printf("Pacing: off\n");
+    } else {
+        printf("Pacing: %s at %.1f Mbit/s, %llu stalls on an empty bucket\n",
+               pacer.mode == PACE_FQ ? "fq" : "bucket", pacer.rate * 8 / 1e6,
+               (unsigned long long)pacer.stalls);
+    }
+    printf("Bursts (segments per flush):");
+    for (int i = 0; i < PACE_HIST_BUCKETS; i++) {
+        uint32_t lo = pacer_bucket_floor(i);
+        if (i == PACE_HIST_BUCKETS - 1) {
+            printf(" %u+: %llu", lo, (unsigned long long)pacer.bursts[i]);
+        } else if (lo == 1) {
+            printf(" 1: %llu", (unsigned long long)pacer.bursts[i]);
+        } else {
+            printf(" %u-%u: %llu", lo, 2 * lo - 1, (unsigned long long)pacer.bursts[i]);
+        }
+    }
+    printf("\n");
+}
+
+// Release the input file mapping, and the compressed blocks and parity
+// sent from it
+void unmap_file(void *map, size_t map_len) {
+    if (map) {
+        munmap(map, map_len);
+    }
+    free(compress_buffer);
+    compress_buffer = NULL;
+    fec_encoder_free(&fec);
+}
+
+// How much compression saved, and what it cost
+void print_compression_stats(void) {
+    const struct compress_stats *st = &compressor.stats;
+    printf("Compression: %s, %llu bytes sent as %llu (ratio %.2f), %llu of %llu segments compressed\n",
+           compress_name(compress_alg), (unsigned long long)st->raw_bytes,
+           (unsigned long long)st->wire_bytes, st->wire_bytes ? (double)st->raw_bytes / st->wire_bytes : 1.0,
+           (unsigned long long)st->compressed, (unsigned long long)st->segments);
+    printf("Compression CPU: %.1f ms (%.1f MB/s)\n", st->busy_us / 1000.0,
+           st->busy_us ? (double)st->raw_bytes / st->busy_us : 0.0);
+}
+
+// Parity sent, what it cost, and the losses it repaired
+void print_fec_stats(void) {
+    const struct fec_stats *st = &fec.stats;
+    printf("FEC: %llu parity segments for %llu data segments (%.1f%% overhead), %llu rebuilt by the receiver\n",
+           (unsigned long long)st->parity_segments, (unsigned long long)st->data_segments,
+           st->data_segments ? 100.0 * st->parity_segments / st->data_segments : 0.0,
+           (unsigned long long)st->rebuilt);
+    printf("FEC loss estimate: %.2f%%, %u segments per parity at the end\n", fec.loss * 100, fec.block);
+}
+
+// Digest the part of the file a resumed transfer skips. The receiver
+// restored its digest of those bytes from its checkpoint, so the sender's
+// must cover them too for the two to agree at the FIN.
+int digest_prefix(int fd, uint64_t len) {
+    uint8_t *buf = malloc(SHAM_STREAM_ALIGN);
+    if (!buf) {
+        return -1;
+    }
+    for (uint64_t pos = 0; pos < len; ) {
+        size_t want = len - pos < SHAM_STREAM_ALIGN ? len - pos : SHAM_STREAM_ALIGN;
+        ssize_t n = pread(fd, buf, want, (off_t)pos);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            perror("Failed to read file");
+            free(buf);
+            return -1;
+        }
+        digest_update(&tx_digest, buf, n);
+        pos += n;
+    }
+    free(buf);
+    return 0;
+}
+
+// Identify a file across runs by its name, size and modification time, so
+// a changed file is never resumed onto an old partial copy
+uint64_t file_identity(const char *filename, const struct stat *st) {
+    struct digest d;
+    uint8_t value[DIGEST_MAX_LENGTH];
+    const char *base = strrchr(filename, '/');
+    base = base ? base + 1 : filename;
+    
+    digest_init(&d, DIGEST_XXH64);
+    digest_update(&d, base, strlen(base));
+    digest_update(&d, &st->st_size, sizeof(st->st_size));
+    digest_update(&d, &st->st_mtim, sizeof(st->st_mtim));
+    digest_final(&d, value);
+    
+    uint64_t id = 0;
+    for (int i = 0; i < 8; i++) {
+        id = id << 8 | value[i];
+    }
+    return id;
+}
+
+// Send file with sliding window; a stream of a parallel transfer sends
+// only its range, and a resumed transfer what the server is missing
 int send_file(int sockfd, struct sockaddr_in *server_addr, const char *filename) {
-    FILE *f = fopen(filename, "rb");
-    if (!f) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         perror("Failed to open file");
         return -1;
     }
     
-    // Get file size
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("Failed to stat file");
+        close(fd);
+        return -1;
+    }
+    long file_size = st.st_size;
+    uint64_t start = 0;
+    if (stream.num_streams > 1) {
+        file_size = transfer_size;
+        start = stream.offset;
+    } else if (resume_offset > 0) {
+        file_size -= resume_offset;
+        start = resume_offset;
+    }
     
-    printf("Sending file: %s (%ld bytes)\n", filename, file_size);
+    digest_init(&tx_digest, digest_alg);
+    if (resume_offset > 0 && digest_prefix(fd, resume_offset) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    // Map the whole file, or what is left to send: segments and their
+    // retransmissions are sent straight from the mapping, with no copy in
+    // user space. The mapping starts at the page holding the first byte.
+    const uint8_t *file_data = NULL;
+    void *map = NULL;
+    size_t map_len = 0;
+    if (file_size > 0) {
+        off_t map_start = (off_t)start & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+        map_len = file_size + (start - map_start);
+        map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, map_start);
+        if (map == MAP_FAILED) {
+            perror("Failed to map file");
+            close(fd);
+            return -1;
+        }
+        madvise(map, map_len, MADV_SEQUENTIAL);
+        file_data = (const uint8_t *)map + (start - map_start);
+    }
+    close(fd);
+    
+    if (stream.num_streams > 1) {
+        printf("Sending bytes %llu-%llu of %s\n", (unsigned long long)stream.offset,
+               (unsigned long long)(stream.offset + file_size), filename);
+    } else if (resume_offset > 0) {
+        printf("Resuming file: %s at byte %llu of %llu\n", filename,
+               (unsigned long long)resume_offset, (unsigned long long)st.st_size);
+    } else {
+        printf("Sending file: %s (%ld bytes)\n", filename, file_size);
+    }
     
     // Initialize window
     memset(window, 0, sizeof(window));
+    timer_wheel_init(&timers, timer_now_ms());
+    for (int i = 0; i < SHAM_MAX_WINDOW; i++) {
+        timer_init(&window[i].rto_timer, on_retransmit_timer);
+    }
+    timer_init(&persist_timer, on_persist_timer);
+    timer_init(&pace_timer, on_pace_timer);
+    cc_init(&cc, cc_algorithm, mss, SHAM_WINDOW_SIZE, SHAM_MAX_WINDOW * mss);
+    pacer_init(&pacer, pace_mode, mss, pace_max_rate, timer_now_us());
+    recovery_point = window_base;
+    if (compress_alg != COMPRESS_NONE) {
+        compressor_init(&compressor, compress_alg);
+        compress_buffer = malloc((size_t)SHAM_MAX_WINDOW * mss);
+        if (!compress_buffer) {
+            perror("Failed to allocate compression buffers");
+            compress_alg = COMPRESS_NONE;
+        }
+    }
+    if (fec_enabled && fec_encoder_init(&fec, mss) < 0) {
+        perror("Failed to allocate parity buffers");
+        fec_enabled = false;
+    }
     
     bool done_sending = false;
-    uint8_t buffer[SHAM_DATA_SIZE];
     
-    while (window_base < next_seq_num + (uint32_t)file_size || !done_sending) {
-        // Send new packets within window
-        while (!done_sending && (next_seq_num - window_base) < SHAM_WINDOW_SIZE * SHAM_DATA_SIZE) {
-            size_t bytes_read = fread(buffer, 1, SHAM_DATA_SIZE, f);
-            if (bytes_read == 0) {
+    while (window_base < data_start_seq + (uint64_t)file_size || !done_sending) {
+        uint64_t now = timer_now_ms();
+        
+        // The pacing rate tracks the window and RTT as they change
+        pacer_set_rate(&pacer, sockfd, cc_pacing_rate(&cc, rtt.srtt_us));
+        pacer_refill(&pacer, timer_now_us());
+        
+        // Send new packets within the congestion and receiver windows, as
+        // fast as the pacer allows
+        while (!done_sending && usable_window() >= mss) {
+            long offset = next_seq_num - data_start_seq;
+            if (offset >= file_size) {
                 done_sending = true;
                 break;
             }
+            uint32_t seg_len = file_size - offset < mss ? file_size - offset : mss;
+            if (!pacer_ready(&pacer, seg_len)) {
+                if (!timer_pending(&pace_timer)) {
+                    uint64_t delay_us = pacer_delay_us(&pacer, seg_len);
+                    timer_arm(&timers, &pace_timer, now + (delay_us + 999) / 1000);
+                }
+                break;
+            }
             
-            int win_idx = ((next_seq_num - window_base) / SHAM_DATA_SIZE) % SHAM_WINDOW_SIZE;
+            struct packet_window *entry = &window[window_slot(next_seq_num)];
+            entry->header.seq_num = (uint32_t)next_seq_num;
+            entry->header.ack_num = 0;
+            entry->header.flags = 0;
+            entry->header.window_size = 65535;
+            entry->data = file_data + offset;
+            entry->data_len = seg_len;
+            entry->payload = entry->data;
+            entry->payload_len = seg_len;
             
-            memset(&window[win_idx].packet, 0, sizeof(struct sham_packet));
-            window[win_idx].packet.header.seq_num = next_seq_num;
-            window[win_idx].packet.header.flags = 0;
-            window[win_idx].packet.header.window_size = 65535;
-            memcpy(window[win_idx].packet.data, buffer, bytes_read);
-            window[win_idx].data_len = bytes_read;
-            window[win_idx].acked = false;
-            window[win_idx].retries = 0;
-            gettimeofday(&window[win_idx].send_time, NULL);
+            // Compressing a window's worth of segments takes a while, so
+            // the clock is read again for the retransmission deadline
+            if (compress_buffer) {
+                uint8_t *block = compress_buffer + (size_t)window_slot(next_seq_num) * mss;
+                uint32_t block_len = compressor_encode(&compressor, entry->data, seg_len, block);
+                if (block_len > 0) {
+                    entry->header.flags = SHAM_COMPRESSED;
+                    entry->payload = block;
+                    entry->payload_len = block_len;
+                }
+                now = timer_now_ms();
+            }
+            entry->acked = false;
+            entry->fast_retx = false;
+            entry->retries = 0;
+            gettimeofday(&entry->send_time, NULL);
+            arm_retransmit(entry, now);
             
-            log_event("SND DATA SEQ=%u LEN=%u", next_seq_num, (uint32_t)bytes_read);
-            send_packet(sockfd, server_addr, &window[win_idx].packet, bytes_read);
+            log_event("SND DATA SEQ=%u LEN=%u", entry->header.seq_num, seg_len);
+            queue_segment(server_addr, entry);
+            if (fec_enabled) {
+                queue_parity(server_addr, entry, offset + seg_len >= file_size);
+            }
+            digest_update(&tx_digest, entry->data, seg_len);
             
-            next_seq_num += bytes_read;
+            next_seq_num += seg_len;
         }
         
-        // Wait for ACKs
-        struct sham_packet ack_pkt;
-        uint32_t ack_data_len;
-        int recv_ret = recv_packet_timeout(sockfd, &ack_pkt, server_addr, &ack_data_len, 100);
+        pacer_end_burst(&pacer);
+        send_batch_flush(&tx_batch);
         
-        if (recv_ret > 0 && (ack_pkt.header.flags & SHAM_ACK)) {
-            log_event("RCV ACK=%u", ack_pkt.header.ack_num);
-            
-            // Update window base (cumulative ACK)
-            if (ack_pkt.header.ack_num > window_base) {
-                window_base = ack_pkt.header.ack_num;
+        // Drain every ACK already queued; only block when there is none,
+        // and then only until the earliest retransmission or persist deadline
+        int num_acks = recv_batch_drain(sockfd, &rx_batch);
+        if (num_acks == 0 && timers.count > 0) {
+            reactor_set_deadline(&reactor, timer_wheel_next(&timers));
+            if (reactor_wait(&reactor, -1) & REACTOR_SOCKET) {
+                num_acks = recv_batch_drain(sockfd, &rx_batch);
             }
-            
-            peer_window = ack_pkt.header.window_size;
-            log_event("FLOW WIN UPDATE=%u", peer_window);
+        }
+        now = timer_now_ms();
+        
+        for (int i = 0; i < num_acks; i++) {
+            if (packet_intact(rx_batch.pkts[i], rx_batch.len[i] - SHAM_HEADER_SIZE)) {
+                handle_ack(server_addr, rx_batch.pkts[i], rx_batch.len[i] - SHAM_HEADER_SIZE, now);
+            }
+        }
+        
+        // Selective acknowledgement: resend only what the receiver is missing
+        if (num_acks > 0 && retransmit_sack_holes(server_addr, now) > 0) {
+            enter_recovery();
         }
         
-        // Check for timeouts and retransmit
-        for (int i = 0; i < SHAM_WINDOW_SIZE; i++) {
-            uint32_t pkt_seq = window_base + i * SHAM_DATA_SIZE;
-            if (pkt_seq >= next_seq_num) break;
-            if (pkt_seq < window_base) continue;
+        // Retransmit every segment whose timer has expired
+        num_expired = 0;
+        timer_wheel_advance(&timers, now, NULL);
+        for (int i = 0; i < num_expired; i++) {
+            struct packet_window *entry = expired[i];
+            if (entry->retries >= SHAM_MAX_RETRIES) {
+                fprintf(stderr, "Max retries exceeded\n");
+                send_batch_flush(&tx_batch);
+                unmap_file(map, map_len);
+                return -1;
+            }
             
-            int win_idx = ((pkt_seq - window_base) / SHAM_DATA_SIZE) % SHAM_WINDOW_SIZE;
+            log_event("TIMEOUT SEQ=%u", entry->header.seq_num);
+            log_event("RETX DATA SEQ=%u LEN=%u", entry->header.seq_num, entry->data_len);
             
-            if (!window[win_idx].acked && is_timeout(&window[win_idx].send_time, SHAM_TIMEOUT_MS)) {
-                if (window[win_idx].retries >= SHAM_MAX_RETRIES) {
-                    fprintf(stderr, "Max retries exceeded\n");
-                    fclose(f);
-                    return -1;
-                }
-                
-                log_event("TIMEOUT SEQ=%u", window[win_idx].packet.header.seq_num);
-                log_event("RETX DATA SEQ=%u LEN=%u", 
-                         window[win_idx].packet.header.seq_num, window[win_idx].data_len);
-                
-                send_packet(sockfd, server_addr, &window[win_idx].packet, window[win_idx].data_len);
-                gettimeofday(&window[win_idx].send_time, NULL);
-                window[win_idx].retries++;
+            queue_segment(server_addr, entry);
+            gettimeofday(&entry->send_time, NULL);
+            entry->retries++;
+            timeout_retx_count++;
+            if (fec_enabled) {
+                fec_on_loss(&fec);
+            }
+        }
+        
+        // Exponential backoff, once per expiry rather than once per segment;
+        // the resent segments wait out the backed-off timeout
+        if (num_expired > 0) {
+            rtt_backoff(&rtt);
+            log_event("RTO BACKOFF=%d RTO=%ums", rtt.backoff, rtt.rto_ms);
+            for (int i = 0; i < num_expired; i++) {
+                arm_retransmit(expired[i], now);
             }
+            
+            cc_on_timeout(&cc, next_seq_num - window_base);
+            recovery_point = next_seq_num;
+            exit_recovery();
+            log_event("CC TIMEOUT CWND=%u SSTHRESH=%u", cc.cwnd, cc.ssthresh);
+        }
+        
+        if (!done_sending && check_persist_timer(sockfd, server_addr, now) < 0) {
+            send_batch_flush(&tx_batch);
+            unmap_file(map, map_len);
+            return -1;
         }
         
         // Break if all acknowledged
@@ -264,66 +1120,126 @@ int send_file(int sockfd, struct sockaddr_in *server_addr, const char *filename)
         }
     }
     
-    fclose(f);
+    // Everything is acknowledged, so no queued datagram still points into the mapping
+    unmap_file(map, map_len);
     printf("File sent successfully\n");
+    printf("Retransmissions: %u (timeout %u, SACK %u, dupACK %u)\n",
+           timeout_retx_count + sack_retx_count + dupack_retx_count,
+           timeout_retx_count, sack_retx_count, dupack_retx_count);
+    printf("Segment size: %u bytes\n", mss);
+    printf("SRTT: %.3f ms, RTO: %u ms\n", rtt.srtt_us / 1000.0, rtt.rto_ms);
+    printf("Congestion control: %s (cwnd %u bytes, %u loss events, %u timeouts)\n",
+           cc.ops->name, cc.cwnd, cc.loss_events, cc.timeouts);
+    if (zero_window_probes > 0) {
+        printf("Zero-window probes: %u\n", zero_window_probes);
+    }
+    if (checksum_errors > 0) {
+        printf("Checksum errors: %u corrupted datagrams dropped\n", checksum_errors);
+    }
+    print_pacing_stats();
+    if (compress_alg != COMPRESS_NONE) {
+        print_compression_stats();
+    }
+    if (fec_enabled) {
+        print_fec_stats();
+    }
+    printf("I/O: %llu packets in %llu send calls (%.1f/call), %llu packets in %llu receive calls (%.1f/call)\n",
+           (unsigned long long)io_stats.packets_sent, (unsigned long long)io_stats.send_calls,
+           io_stats.send_calls ? (double)io_stats.packets_sent / io_stats.send_calls : 0.0,
+           (unsigned long long)io_stats.packets_received, (unsigned long long)io_stats.recv_calls,
+           io_stats.recv_calls ? (double)io_stats.packets_received / io_stats.recv_calls : 0.0);
+    if (io_stats.gso_sends > 0) {
+        printf("Offload: %llu packets in %llu GSO sends\n",
+               (unsigned long long)io_stats.gso_packets, (unsigned long long)io_stats.gso_sends);
+    }
+    if (io_stats.truncated > 0) {
+        printf("I/O: %llu oversized datagrams dropped\n", (unsigned long long)io_stats.truncated);
+    }
     return 0;
 }
 
 // Perform 4-way termination
-void perform_termination(int sockfd, struct sockaddr_in *server_addr) {
+int perform_termination(int sockfd, struct sockaddr_in *server_addr) {
     struct sham_packet pkt;
     uint32_t data_len;
     
-    // Send FIN
+    // Send FIN, carrying the digest of everything sent so the receiver can
+    // verify the file as soon as it has the last byte
     memset(&pkt, 0, sizeof(pkt));
-    pkt.header.seq_num = next_seq_num;
+    pkt.header.seq_num = (uint32_t)next_seq_num;
     pkt.header.flags = SHAM_FIN;
     pkt.header.window_size = 65535;
     
-    log_event("SND FIN SEQ=%u", next_seq_num);
-    send_packet(sockfd, server_addr, &pkt, 0);
+    char hex[2 * DIGEST_MAX_LENGTH + 1];
+    tx_digest_len = digest_final(&tx_digest, tx_digest_value);
+    uint32_t opt_len = 0;
+    sham_opt_put(pkt.data, &opt_len, SHAM_DATA_SIZE, SHAM_OPT_DIGEST_VALUE, tx_digest_value, tx_digest_len);
+    digest_hex(tx_digest_value, tx_digest_len, hex);
+    printf("Sender %s: %s\n", digest_name(digest_alg), hex);
     
-    // Wait for ACK
-    recv_packet_timeout(sockfd, &pkt, server_addr, &data_len, SHAM_TIMEOUT_MS);
-    log_event("RCV ACK FOR FIN");
-    
-    // Wait for server's FIN
-    recv_packet_timeout(sockfd, &pkt, server_addr, &data_len, SHAM_TIMEOUT_MS);
-    log_event("RCV FIN SEQ=%u", pkt.header.seq_num);
+    // Repeat the FIN until the server's own FIN arrives; a repeated FIN
+    // makes the server send its ACK and FIN again if those were lost
+    struct sham_packet reply;
+    bool peer_fin = false;
+    for (int attempt = 0; attempt <= SHAM_MAX_RETRIES && !peer_fin; attempt++) {
+        log_event("SND FIN SEQ=%u", pkt.header.seq_num);
+        send_packet(sockfd, server_addr, &pkt, opt_len);
+        
+        // Late ACKs for data may still be queued ahead of the reply
+        while (recv_packet_timeout(sockfd, &reply, server_addr, &data_len, rtt.rto_ms) > 0) {
+            if (reply.header.flags & SHAM_FIN) {
+                log_event("RCV FIN SEQ=%u", reply.header.seq_num);
+                peer_fin = true;
+                break;
+            }
+            if ((reply.header.flags & SHAM_ACK) && reply.header.ack_num == (uint32_t)(next_seq_num + 1)) {
+                log_event("RCV ACK FOR FIN");
+            }
+        }
+    }
+    if (!peer_fin) {
+        fprintf(stderr, "No FIN from server\n");
+        return -1;
+    }
     
     // Send final ACK
+    uint32_t server_fin_seq = reply.header.seq_num;
     memset(&pkt, 0, sizeof(pkt));
-    pkt.header.ack_num = pkt.header.seq_num + 1;
+    pkt.header.ack_num = server_fin_seq + 1;
     pkt.header.flags = SHAM_ACK;
     pkt.header.window_size = 65535;
     
     log_event("SND ACK=%u", pkt.header.ack_num);
     send_packet(sockfd, server_addr, &pkt, 0);
+    
+    // The server's FIN carries the digest of what it received
+    uint8_t peer_digest[DIGEST_MAX_LENGTH];
+    if (!chat_mode && sham_opt_get(reply.data, data_len, SHAM_OPT_DIGEST_VALUE, peer_digest, tx_digest_len) &&
+        memcmp(peer_digest, tx_digest_value, tx_digest_len) != 0) {
+        digest_hex(peer_digest, tx_digest_len, hex);
+        fprintf(stderr, "DIGEST MISMATCH: server received %s\n", hex);
+        return -1;
+    }
+    return 0;
 }
 
 // Handle chat mode
 void handle_chat_mode(int sockfd, struct sockaddr_in *server_addr) {
-    fd_set read_fds;
     struct sham_packet pkt;
-    uint32_t data_len;
+    bool peer_closed = false;
     
+    // Input is line-buffered by stdio, so it stays level-triggered
+    if (reactor_add(&reactor, STDIN_FILENO, REACTOR_STDIN, false) < 0) {
+        perror("Failed to watch stdin");
+        return;
+    }
     printf("Chat mode started. Type /quit to exit.\n");
     
-    while (1) {
-        FD_ZERO(&read_fds);
-        FD_SET(STDIN_FILENO, &read_fds);
-        FD_SET(sockfd, &read_fds);
-        
-        struct timeval tv = {1, 0};
-        int ret = select(sockfd + 1, &read_fds, NULL, NULL, &tv);
-        
-        if (ret < 0) {
-            perror("select");
-            break;
-        }
+    while (!peer_closed) {
+        uint32_t ready = reactor_wait(&reactor, -1);
         
         // Check stdin
-        if (FD_ISSET(STDIN_FILENO, &read_fds)) {
+        if (ready & REACTOR_STDIN) {
             char line[SHAM_DATA_SIZE];
             if (fgets(line, sizeof(line), stdin)) {
                 if (strncmp(line, "/quit", 5) == 0) {
@@ -333,7 +1249,7 @@ void handle_chat_mode(int sockfd, struct sockaddr_in *server_addr) {
                 
                 // Send message
                 memset(&pkt, 0, sizeof(pkt));
-                pkt.header.seq_num = next_seq_num;
+                pkt.header.seq_num = (uint32_t)next_seq_num;
                 pkt.header.flags = 0;
                 size_t len = strlen(line);
                 memcpy(pkt.data, line, len);
@@ -342,24 +1258,306 @@ void handle_chat_mode(int sockfd, struct sockaddr_in *server_addr) {
             }
         }
         
-        // Check socket
-        if (FD_ISSET(sockfd, &read_fds)) {
-            if (recv_packet_timeout(sockfd, &pkt, server_addr, &data_len, 0) > 0) {
-                if (pkt.header.flags & SHAM_FIN) {
-                    break;
-                }
-                if (data_len > 0) {
-                    printf("Peer: %.*s", (int)data_len, pkt.data);
+        // Check socket, reading until it is empty
+        if (ready & REACTOR_SOCKET) {
+            int count;
+            while (!peer_closed && (count = recv_batch_drain(sockfd, &rx_batch)) > 0) {
+                for (int i = 0; i < count; i++) {
+                    uint32_t data_len = rx_batch.len[i] - SHAM_HEADER_SIZE;
+                    if (!packet_intact(rx_batch.pkts[i], data_len)) {
+                        continue;
+                    }
+                    if (rx_batch.pkts[i]->header.flags & SHAM_FIN) {
+                        peer_closed = true;
+                        break;
+                    }
+                    if (data_len > 0) {
+                        printf("Peer: %.*s", (int)data_len, rx_batch.pkts[i]->data);
+                    }
                 }
             }
         }
     }
 }
 
+// Create the UDP socket with its event loop and batches
+int open_socket(void) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("socket");
+        return -1;
+    }
+    // A full scaled window leaves in one burst; a datagram the socket
+    // buffer cannot take is lost
+    int sndbuf = SHAM_SEND_BUFFER;
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    if (reactor_init(&reactor) < 0 || reactor_add(&reactor, sockfd, REACTOR_SOCKET, true) < 0) {
+        perror("Failed to set up event loop");
+        close(sockfd);
+        return -1;
+    }
+    
+    send_batch_init(&tx_batch, sockfd, &io_stats);
+    recv_batch_init(&rx_batch, &io_stats);
+    if (offload) {
+        send_batch_enable_gso(&tx_batch);
+    }
+    return sockfd;
+}
+
+// Cut the file into at most num_streams ranges of whole SHAM_STREAM_ALIGN
+// units; returns the range size and leaves num_streams at the number of
+// ranges, which is 1 for a file too small to split
+uint64_t plan_ranges(uint64_t file_size) {
+    uint64_t range_size = (file_size + num_streams - 1) / num_streams;
+    range_size = (range_size + SHAM_STREAM_ALIGN - 1) / SHAM_STREAM_ALIGN * SHAM_STREAM_ALIGN;
+    num_streams = range_size > 0 ? (int)((file_size + range_size - 1) / range_size) : 1;
+    if (num_streams < 1) num_streams = 1;
+    return range_size;
+}
+
+// One sender process of a parallel transfer
+struct stream_proc {
+    pid_t pid;
+    int out_fd;                    // Its stdout and stderr, relayed with a prefix
+    int result_fd;                 // Its range digest, once the transfer is done
+    char line[512];                // Output not yet ending in a newline
+    size_t line_len;
+};
+
+// Body of a stream's process: an ordinary transfer of one range. Reports
+// the range digest on result_fd; returns the exit status.
+int run_stream(struct sockaddr_in *server_addr, const char *filename, int result_fd) {
+    char log_name[32];
+    close_logging();
+    snprintf(log_name, sizeof(log_name), "client_log.%u.txt", stream.index + 1);
+    init_logging(log_name);
+    
+    int sockfd = open_socket();
+    if (sockfd < 0) {
+        return 1;
+    }
+    int status = 1;
+    if (perform_handshake(sockfd, server_addr) == 0) {
+        printf("Connection established\n");
+        if (send_file(sockfd, server_addr, filename) == 0 && perform_termination(sockfd, server_addr) == 0) {
+            status = write(result_fd, tx_digest_value, tx_digest_len) == (ssize_t)tx_digest_len ? 0 : 1;
+        }
+    }
+    reactor_close(&reactor);
+    close(sockfd);
+    close_logging();
+    return status;
+}
+
+// Print a stream's complete output lines with its number in front
+void relay_stream_output(struct stream_proc *p, int index, bool at_eof) {
+    char *start = p->line;
+    char *newline;
+    while ((newline = memchr(start, '\n', p->line + p->line_len - start)) != NULL) {
+        printf("[stream %d] %.*s\n", index + 1, (int)(newline - start), start);
+        start = newline + 1;
+    }
+    p->line_len -= start - p->line;
+    memmove(p->line, start, p->line_len);
+    
+    // A line longer than the buffer, or cut off by the exit, goes out as is
+    if (p->line_len > 0 && (at_eof || p->line_len == sizeof(p->line))) {
+        printf("[stream %d] %.*s\n", index + 1, (int)p->line_len, p->line);
+        p->line_len = 0;
+    }
+}
+
+// Send the file over num_streams connections at once, one process per
+// range, and combine their range digests as the receiver does
+int send_parallel(struct sockaddr_in *server_addr, const char *filename, uint64_t range_size) {
+    struct stream_proc procs[SHAM_MAX_STREAMS];
+    uint64_t file_size = transfer_size;
+    uint64_t transfer_id = ((uint64_t)rand() << 32) ^ (uint64_t)rand() ^ timer_now_us() ^ (uint64_t)getpid();
+    uint64_t start_us = timer_now_us();
+    
+    printf("Sending file: %s (%llu bytes) over %d streams\n", filename,
+           (unsigned long long)file_size, num_streams);
+    fflush(stdout);
+    
+    int started = 0;
+    for (int i = 0; i < num_streams; i++) {
+        int out_pipe[2], result_pipe[2];
+        if (pipe(out_pipe) < 0) {
+            perror("pipe");
+            break;
+        }
+        if (pipe(result_pipe) < 0) {
+            perror("pipe");
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+            break;
+        }
+        
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(out_pipe[0]);
+            close(result_pipe[0]);
+            dup2(out_pipe[1], STDOUT_FILENO);
+            dup2(out_pipe[1], STDERR_FILENO);
+            close(out_pipe[1]);
+            setvbuf(stdout, NULL, _IOLBF, 0);
+            
+            stream.transfer_id = transfer_id;
+            stream.offset = (uint64_t)i * range_size;
+            stream.total_size = file_size;
+            stream.index = i;
+            stream.num_streams = num_streams;
+            transfer_size = file_size - stream.offset < range_size ? file_size - stream.offset : range_size;
+            exit(run_stream(server_addr, filename, result_pipe[1]));
+        }
+        close(out_pipe[1]);
+        close(result_pipe[1]);
+        if (pid < 0) {
+            perror("fork");
+            close(out_pipe[0]);
+            close(result_pipe[0]);
+            break;
+        }
+        procs[i].pid = pid;
+        procs[i].out_fd = out_pipe[0];
+        procs[i].result_fd = result_pipe[0];
+        procs[i].line_len = 0;
+        started++;
+    }
+    
+    // Relay output until every stream has closed its end
+    int open_streams = started;
+    while (open_streams > 0) {
+        struct pollfd pfds[SHAM_MAX_STREAMS];
+        for (int i = 0; i < started; i++) {
+            pfds[i].fd = procs[i].out_fd;
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+        if (poll(pfds, started, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        for (int i = 0; i < started; i++) {
+            if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            struct stream_proc *p = &procs[i];
+            ssize_t n = read(p->out_fd, p->line + p->line_len, sizeof(p->line) - p->line_len);
+            if (n > 0) {
+                p->line_len += n;
+                relay_stream_output(p, i, false);
+            } else if (n == 0 || errno != EINTR) {
+                relay_stream_output(p, i, true);
+                close(p->out_fd);
+                p->out_fd = -1;
+                open_streams--;
+            }
+        }
+    }
+    
+    // Collect each range's digest; a stream that failed reports none
+    uint8_t range_digests[SHAM_MAX_STREAMS][DIGEST_MAX_LENGTH];
+    size_t digest_len = digest_length(digest_alg);
+    int failed = num_streams - started;
+    for (int i = 0; i < started; i++) {
+        int status;
+        ssize_t n = read(procs[i].result_fd, range_digests[i], digest_len);
+        close(procs[i].result_fd);
+        if (procs[i].out_fd >= 0) close(procs[i].out_fd);
+        while (waitpid(procs[i].pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        if (n != (ssize_t)digest_len || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Stream %d failed\n", i + 1);
+            failed++;
+        }
+    }
+    if (failed > 0) {
+        fprintf(stderr, "Parallel transfer failed: %d of %d streams did not complete\n", failed, num_streams);
+        return -1;
+    }
+    
+    double seconds = (timer_now_us() - start_us) / 1e6;
+    uint8_t combined[DIGEST_MAX_LENGTH];
+    char hex[2 * DIGEST_MAX_LENGTH + 1];
+    digest_hex(combined, digest_combine(digest_alg, range_digests, num_streams, combined), hex);
+    printf("Parallel transfer: %llu bytes over %d streams in %.2f s (%.1f Mbit/s)\n",
+           (unsigned long long)file_size, num_streams, seconds,
+           seconds > 0 ? file_size * 8 / seconds / 1e6 : 0.0);
+    printf("Sender combined %s: %s\n", digest_name(digest_alg), hex);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    // Pull out --option=value flags; what remains is positional
+    int num_args = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--cc=", 5) == 0) {
+            cc_algorithm = cc_lookup(argv[i] + 5);
+            if (!cc_algorithm) {
+                fprintf(stderr, "Unknown congestion control '%s' (available: %s)\n",
+                        argv[i] + 5, cc_available());
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--digest=", 9) == 0) {
+            digest_alg = digest_lookup(argv[i] + 9);
+            if (!digest_alg) {
+                fprintf(stderr, "Unknown digest '%s' (available: %s)\n",
+                        argv[i] + 9, digest_available());
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--mss=", 6) == 0) {
+            int n = atoi(argv[i] + 6);
+            if (n < 1 || n > SHAM_MAX_DATA_SIZE) {
+                fprintf(stderr, "--mss must be between 1 and %d\n", SHAM_MAX_DATA_SIZE);
+                return 1;
+            }
+            mss_limit = n;
+        } else if (strcmp(argv[i], "--no-offload") == 0) {
+            offload = false;
+        } else if (strncmp(argv[i], "--pacing=", 9) == 0) {
+            if (pacer_lookup(argv[i] + 9, &pace_mode) < 0) {
+                fprintf(stderr, "Unknown pacing mode '%s' (available: off, bucket, fq)\n", argv[i] + 9);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--streams=", 10) == 0) {
+            num_streams = atoi(argv[i] + 10);
+            if (num_streams < 1 || num_streams > SHAM_MAX_STREAMS) {
+                fprintf(stderr, "--streams must be between 1 and %d\n", SHAM_MAX_STREAMS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume = true;
+        } else if (strncmp(argv[i], "--compress=", 11) == 0) {
+            compress_alg = compress_lookup(argv[i] + 11);
+            if (compress_alg == COMPRESS_NONE) {
+                fprintf(stderr, "Unknown compression '%s' (available: %s)\n",
+                        argv[i] + 11, compress_available());
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--fec") == 0) {
+            fec_enabled = true;
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            double mbit = atof(argv[i] + 7);
+            if (mbit <= 0) {
+                fprintf(stderr, "--rate must be a positive number of Mbit/s\n");
+                return 1;
+            }
+            pace_max_rate = (uint64_t)(mbit * 1e6 / 8);
+        } else {
+            argv[num_args++] = argv[i];
+        }
+    }
+    argc = num_args;
+    if (!cc_algorithm) cc_algorithm = cc_lookup(CC_DEFAULT);
+    if (!digest_alg) digest_alg = digest_lookup(DIGEST_DEFAULT);
+    
     if (argc < 3) {
-        fprintf(stderr, "Usage: %s <server_ip> <server_port> <input_file> <output_file_name> [loss_rate]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <server_ip> <server_port> <input_file> <output_file_name> [loss_rate] [--cc=<algorithm>] [--digest=<algorithm>] [--mss=N] [--no-offload] [--pacing=off|bucket|fq] [--rate=MBIT] [--streams=N] [--resume] [--compress=<algorithm>] [--fec]\n", argv[0]);
         fprintf(stderr, "   or: %s <server_ip> <server_port> --chat [loss_rate]\n", argv[0]);
+        fprintf(stderr, "Congestion control algorithms: %s (default %s)\n", cc_available(), CC_DEFAULT);
+        fprintf(stderr, "Digest algorithms: %s (default %s)\n", digest_available(), DIGEST_DEFAULT);
+        fprintf(stderr, "Compression algorithms: %s (default none)\n", compress_available());
         return 1;
     }
     
@@ -379,16 +1577,24 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    srand(time(NULL));
-    init_logging("client_log.txt");
-    
-    // Create UDP socket
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) {
-        perror("socket");
+    if (input_file) {
+        struct stat st;
+        if (stat(input_file, &st) < 0) {
+            perror("Failed to open file");
+            return 1;
+        }
+        transfer_size = st.st_size;
+        resume_id = file_identity(input_file, &st);
+    }
+    if (resume && (chat_mode || num_streams > 1)) {
+        fprintf(stderr, "--resume applies to a single-stream file transfer\n");
         return 1;
     }
     
+    srand(time(NULL));
+    init_logging("client_log.txt");
+    log_event("CRC32C=%s", crc32c_init());
+    
     // Setup server address
     struct sockaddr_in server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
@@ -397,7 +1603,22 @@ int main(int argc, char *argv[]) {
     
     if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) {
         fprintf(stderr, "Invalid server IP\n");
-        close(sockfd);
+        return 1;
+    }
+    
+    // Parallel streams each open their own socket
+    if (!chat_mode && num_streams > 1) {
+        uint64_t range_size = plan_ranges(transfer_size);
+        if (num_streams > 1) {
+            int ret = send_parallel(&server_addr, input_file, range_size);
+            close_logging();
+            return ret < 0 ? 1 : 0;
+        }
+    }
+    
+    // Create UDP socket
+    int sockfd = open_socket();
+    if (sockfd < 0) {
         return 1;
     }
     
@@ -412,6 +1633,7 @@ int main(int argc, char *argv[]) {
     printf("Connection established\n");
     
     // Send file or enter chat mode
+    int status = 0;
     if (chat_mode) {
         handle_chat_mode(sockfd, &server_addr);
     } else {
@@ -420,10 +1642,11 @@ int main(int argc, char *argv[]) {
             close_logging();
             return 1;
         }
-        perform_termination(sockfd, &server_addr);
+        status = perform_termination(sockfd, &server_addr) < 0 ? 1 : 0;
     }
     
+    reactor_close(&reactor);
     close(sockfd);
     close_logging();
-    return 0;
+    return status;
 }
@@ -0,0 +1,260 @@
+#include <string.h>
+#include <strings.h>
+#include "compress.h"
+#include "timer_wheel.h"
+
+// LZ block format, as in LZ4: a run of sequences, each a token byte whose
+// high nibble is the literal count and low nibble the match length less
+// LZ_MIN_MATCH, either extended by bytes of 255 and a final smaller one
+// when it reads 15. The token is followed by the literals, then a 2-byte
+// little-endian offset back into the output and the match length bytes.
+// The last sequence has literals only and ends the block.
+
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Multiplicative hash of the next LZ_MIN_MATCH bytes
+static uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Bytes a and b have in common, going no further than limit; compared a
+// word at a time, the first differing byte found from the XOR
+static size_t common_length(const uint8_t *a, const uint8_t *b, const uint8_t *limit) {
+    const uint8_t *start = a;
+    while (limit - a >= 8) {
+        uint64_t x, y;
+        memcpy(&x, a, sizeof(x));
+        memcpy(&y, b, sizeof(y));
+        if (x != y) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return (a - start) + (__builtin_ctzll(x ^ y) >> 3);
+#else
+            return (a - start) + (__builtin_clzll(x ^ y) >> 3);
+#endif
+        }
+        a += 8;
+        b += 8;
+    }
+    while (a < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return a - start;
+}
+
+// Space a length takes beyond its token nibble
+static size_t length_bytes(size_t n) {
+    return n >= 15 ? (n - 15) / 255 + 1 : 0;
+}
+
+static uint8_t *put_length(uint8_t *op, size_t n) {
+    if (n < 15) return op;
+    for (n -= 15; n >= 255; n -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+// Append a sequence: literals, then a match unless match_len is 0.
+// Returns the new output position, or NULL if it would pass oend.
+static uint8_t *put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *literals, size_t num_literals,
+                             uint32_t offset, size_t match_len) {
+    size_t need = 1 + length_bytes(num_literals) + num_literals;
+    if (match_len > 0) {
+        need += 2 + length_bytes(match_len - LZ_MIN_MATCH);
+    }
+    if (need > (size_t)(oend - op)) {
+        return NULL;
+    }
+
+    uint8_t *token = op++;
+    *token = (uint8_t)((num_literals < 15 ? num_literals : 15) << 4);
+    op = put_length(op, num_literals);
+    memcpy(op, literals, num_literals);
+    op += num_literals;
+    if (match_len > 0) {
+        size_t code = match_len - LZ_MIN_MATCH;
+        *token |= (uint8_t)(code < 15 ? code : 15);
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        op = put_length(op, code);
+    }
+    return op;
+}
+
+// Greedy single-probe match finder. After every 64 bytes without a match
+// the scan takes bigger strides, so data with nothing to find is crossed
+// quickly.
+size_t lz_compress(struct compressor *z, const uint8_t *src, size_t len, uint8_t *dst, size_t capacity) {
+    // Positions are 32-bit; start the table afresh before they wrap
+    if (z->base > UINT32_MAX - len - 1) {
+        memset(z->table, 0, sizeof(z->table));
+        z->base = 1;
+    }
+    uint32_t base = z->base;
+    z->base += (uint32_t)len;
+
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + len;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + capacity;
+
+    while (len >= LZ_MIN_MATCH && ip <= end - LZ_MIN_MATCH) {
+        uint32_t v = read_le32(ip);
+        uint32_t h = lz_hash(v);
+        uint32_t pos = base + (uint32_t)(ip - src);
+        uint32_t candidate = z->table[h];
+        z->table[h] = pos;
+
+        if (candidate < base || pos - candidate > LZ_MAX_OFFSET ||
+            read_le32(src + (candidate - base)) != v) {
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        const uint8_t *ref = src + (candidate - base);
+        size_t match_len = LZ_MIN_MATCH + common_length(ip + LZ_MIN_MATCH, ref + LZ_MIN_MATCH, end);
+        op = put_sequence(op, oend, anchor, ip - anchor, (uint32_t)(ip - ref), match_len);
+        if (!op) {
+            return 0;
+        }
+        ip += match_len;
+        anchor = ip;
+    }
+
+    op = put_sequence(op, oend, anchor, end - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+// Read the extension bytes of a length; false if the block ends first
+static bool get_length(const uint8_t **ip, const uint8_t *iend, size_t *n) {
+    uint8_t b;
+    do {
+        if (*ip == iend) return false;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return true;
+}
+
+// Every length and offset is checked against both buffers, so a damaged
+// block is rejected rather than read or written out of bounds
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + len;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + capacity;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t num_literals = token >> 4;
+        if (num_literals == 15 && !get_length(&ip, iend, &num_literals)) return -1;
+        if (num_literals > (size_t)(iend - ip) || num_literals > (size_t)(oend - op)) return -1;
+        memcpy(op, ip, num_literals);
+        op += num_literals;
+        ip += num_literals;
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && !get_length(&ip, iend, &match_len)) return -1;
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst) || match_len > (size_t)(oend - op)) return -1;
+
+        // A match may overlap the bytes it produces, so copy forwards
+        const uint8_t *ref = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        } else {
+            for (size_t i = 0; i < match_len; i++) {
+                *op++ = *ref++;
+            }
+        }
+    }
+    return (int)(op - dst);
+}
+
+// Algorithm lookup
+compress_alg_t compress_lookup(const char *name) {
+    if (strcasecmp(name, "lz") == 0) return COMPRESS_LZ;
+    return COMPRESS_NONE;
+}
+
+const char *compress_name(compress_alg_t alg) {
+    switch (alg) {
+    case COMPRESS_LZ: return "LZ";
+    case COMPRESS_NONE: break;
+    }
+    return NULL;
+}
+
+const char *compress_available(void) {
+    return "lz";
+}
+
+void compressor_init(struct compressor *z, compress_alg_t alg) {
+    memset(z, 0, sizeof(*z));
+    z->alg = alg;
+    z->base = 1;
+}
+
+// The block must beat the segment by COMPRESS_MIN_SAVING, or the receiver
+// would spend time decoding for next to nothing
+uint32_t compressor_encode(struct compressor *z, const uint8_t *src, uint32_t len, uint8_t *dst) {
+    if (z->skip > 0) {
+        z->skip--;
+        compress_count_raw(&z->stats, len);
+        return 0;
+    }
+
+    uint32_t limit = len - len / COMPRESS_MIN_SAVING;
+    size_t block_len = 0;
+    uint64_t start_us = timer_now_us();
+    if (limit > COMPRESS_HEADER_SIZE) {
+        block_len = lz_compress(z, src, len, dst + COMPRESS_HEADER_SIZE, limit - COMPRESS_HEADER_SIZE);
+    }
+    z->stats.busy_us += timer_now_us() - start_us;
+
+    if (block_len == 0) {
+        z->backoff = z->backoff ? z->backoff * 2 : 1;
+        if (z->backoff > COMPRESS_MAX_BACKOFF) z->backoff = COMPRESS_MAX_BACKOFF;
+        z->skip = z->backoff;
+        compress_count_raw(&z->stats, len);
+        return 0;
+    }
+    z->backoff = 0;
+
+    dst[0] = (uint8_t)len;
+    dst[1] = (uint8_t)(len >> 8);
+    uint32_t wire_len = COMPRESS_HEADER_SIZE + (uint32_t)block_len;
+    z->stats.segments++;
+    z->stats.compressed++;
+    z->stats.raw_bytes += len;
+    z->stats.wire_bytes += wire_len;
+    return wire_len;
+}
+
+int compress_decode(struct compress_stats *st, const uint8_t *src, uint32_t len,
+                    uint8_t *dst, uint32_t capacity) {
+    if (len < COMPRESS_HEADER_SIZE) return -1;
+    uint32_t raw_len = src[0] | (uint32_t)src[1] << 8;
+    if (raw_len > capacity) return -1;
+
+    uint64_t start_us = timer_now_us();
+    int n = lz_decompress(src + COMPRESS_HEADER_SIZE, len - COMPRESS_HEADER_SIZE, dst, raw_len);
+    st->busy_us += timer_now_us() - start_us;
+    if (n != (int)raw_len) return -1;
+
+    st->segments++;
+    st->compressed++;
+    st->raw_bytes += raw_len;
+    st->wire_bytes += len;
+    return n;
+}
@@ -0,0 +1,81 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Compression Constants
+#define COMPRESS_HEADER_SIZE 2     // Block frame: uint16_t length of the data it decodes to
+#define COMPRESS_MIN_SAVING 16     // A block must save at least 1/16 of a segment to be sent
+#define COMPRESS_MAX_BACKOFF 64    // Most segments sent raw, untried, after one fails to compress
+#define LZ_MIN_MATCH 4             // Shortest match the codec encodes
+#define LZ_HASH_BITS 12            // Match finder table: 4096 entries
+#define LZ_MAX_OFFSET 65535        // Furthest back a match may reach
+
+// Payload compression for data segments. Each compressed segment is one
+// self-contained block, decodable without any other, so loss and
+// reordering cost nothing beyond the segment itself.
+typedef enum {
+    COMPRESS_NONE = 0,
+    COMPRESS_LZ = 1                // Byte-oriented LZ77, in the style of LZ4
+} compress_alg_t;
+
+// Work done, in segments and bytes, and the time spent coding
+struct compress_stats {
+    uint64_t segments;             // Data segments seen
+    uint64_t compressed;           // ...of which went compressed
+    uint64_t raw_bytes;            // Stream bytes they carry
+    uint64_t wire_bytes;           // Payload bytes on the wire
+    uint64_t busy_us;              // Time inside the codec
+};
+
+// Compressor: the codec, its match finder and the skip policy. The match
+// table keeps positions across segments but only trusts those at or above
+// base, so a new block starts with an empty table without clearing it.
+// A segment that fails to compress has the next backoff segments sent raw
+// without trying, doubling up to COMPRESS_MAX_BACKOFF, so incompressible
+// data costs little more than a probe now and then.
+struct compressor {
+    compress_alg_t alg;
+    uint32_t table[1 << LZ_HASH_BITS];
+    uint32_t base;                 // Position of the current block's first byte
+    uint32_t backoff;              // Segments to skip after the next failure
+    uint32_t skip;                 // Segments still to send untried
+    struct compress_stats stats;
+};
+
+// Look up an algorithm by name ("lz"); COMPRESS_NONE if unknown
+compress_alg_t compress_lookup(const char *name);
+
+// Name for messages, "LZ"; NULL for an unknown algorithm or none
+const char *compress_name(compress_alg_t alg);
+
+// Comma-separated list of available algorithms, for usage messages
+const char *compress_available(void);
+
+void compressor_init(struct compressor *z, compress_alg_t alg);
+
+// Compress a segment into a framed block at dst, which holds len bytes.
+// Returns the block's length, or 0 if the segment should go as it is.
+uint32_t compressor_encode(struct compressor *z, const uint8_t *src, uint32_t len, uint8_t *dst);
+
+// Decode a framed block into dst (capacity bytes); returns the decoded
+// length, or -1 if the block is malformed or does not fit. Decoding needs
+// no state beyond the block, so a receiver keeps just the statistics.
+int compress_decode(struct compress_stats *st, const uint8_t *src, uint32_t len,
+                    uint8_t *dst, uint32_t capacity);
+
+// Count a segment that went raw
+static inline void compress_count_raw(struct compress_stats *st, uint32_t len) {
+    st->segments++;
+    st->raw_bytes += len;
+    st->wire_bytes += len;
+}
+
+// The block codec itself. lz_compress returns the compressed length, or 0
+// if it would exceed capacity; lz_decompress the decoded length, or -1.
+size_t lz_compress(struct compressor *z, const uint8_t *src, size_t len, uint8_t *dst, size_t capacity);
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity);
+
+#endif // COMPRESS_H
@@ -0,0 +1,377 @@
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "congestion.h"
+
+// Monotonic clock in microseconds
+static uint64_t cc_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t max_u32(uint32_t a, uint32_t b) {
+    return a > b ? a : b;
+}
+
+// Slow start: grow by the bytes acknowledged, at most up to ssthresh
+static void slow_start(struct cc_state *cc, uint32_t acked_bytes) {
+    uint32_t room = cc->ssthresh - cc->cwnd;
+    cc->cwnd += acked_bytes < room ? acked_bytes : room;
+}
+
+// Reno congestion avoidance: one segment per window of acknowledged bytes
+static void reno_avoidance(struct cc_state *cc, uint32_t acked_bytes) {
+    cc->cwnd_acc += acked_bytes;
+    while (cc->cwnd_acc >= cc->cwnd) {
+        cc->cwnd_acc -= cc->cwnd;
+        cc->cwnd += cc->mss;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Reno: slow start, additive increase, halve on loss, restart on timeout
+// ---------------------------------------------------------------------------
+
+static void reno_init(struct cc_state *cc) {
+}
+
+static void reno_on_ack(struct cc_state *cc, const struct cc_ack *ack) {
+    if (cc->cwnd < cc->ssthresh) {
+        slow_start(cc, ack->acked_bytes);
+    } else {
+        reno_avoidance(cc, ack->acked_bytes);
+    }
+}
+
+static void reno_on_loss(struct cc_state *cc, uint32_t bytes_in_flight) {
+    cc->ssthresh = max_u32(bytes_in_flight / 2, CC_MIN_CWND_SEGS * cc->mss);
+    cc->cwnd = cc->ssthresh;
+    cc->cwnd_acc = 0;
+}
+
+static void reno_on_timeout(struct cc_state *cc, uint32_t bytes_in_flight) {
+    cc->ssthresh = max_u32(bytes_in_flight / 2, CC_MIN_CWND_SEGS * cc->mss);
+    cc->cwnd = cc->mss;
+    cc->cwnd_acc = 0;
+}
+
+// Window-based pacing: spread cwnd over one SRTT, faster in slow start so
+// pacing never holds back the window's growth
+static uint64_t window_pacing_rate(struct cc_state *cc, uint32_t srtt_us) {
+    if (srtt_us == 0) return 0;
+    double gain = cc->cwnd < cc->ssthresh ? CC_PACING_SS_GAIN : CC_PACING_CA_GAIN;
+    return (uint64_t)(gain * cc->cwnd * 1000000.0 / srtt_us);
+}
+
+// ---------------------------------------------------------------------------
+// CUBIC (RFC 8312): window grows as a cubic function of time since the last
+// reduction, centred on the window where loss last occurred
+// ---------------------------------------------------------------------------
+
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+
+static void cubic_init(struct cc_state *cc) {
+    memset(&cc->u.cubic, 0, sizeof(cc->u.cubic));
+    cc->u.cubic.min_rtt_us = UINT32_MAX;
+}
+
+static void cubic_on_ack(struct cc_state *cc, const struct cc_ack *ack) {
+    struct cubic_state *c = &cc->u.cubic;
+
+    if (ack->rtt_us && ack->rtt_us < c->min_rtt_us) {
+        c->min_rtt_us = ack->rtt_us;
+    }
+    if (cc->cwnd < cc->ssthresh) {
+        slow_start(cc, ack->acked_bytes);
+        return;
+    }
+
+    double cwnd_segs = (double)cc->cwnd / cc->mss;
+    double acked_segs = (double)ack->acked_bytes / cc->mss;
+    uint64_t now = cc_now_us();
+
+    // Start a new epoch on the first ACK after a reduction
+    if (c->epoch_start_us == 0) {
+        c->epoch_start_us = now;
+        if (cwnd_segs < c->w_max) {
+            c->k = cbrt((c->w_max - cwnd_segs) / CUBIC_C);
+        } else {
+            c->k = 0;
+            c->w_max = cwnd_segs;
+        }
+        c->w_est = cwnd_segs;
+    }
+
+    double rtt_s = c->min_rtt_us == UINT32_MAX ? 0 : c->min_rtt_us / 1e6;
+    double t = (now - c->epoch_start_us) / 1e6 + rtt_s;
+    double target = CUBIC_C * (t - c->k) * (t - c->k) * (t - c->k) + c->w_max;
+    if (target > 1.5 * cwnd_segs) {
+        target = 1.5 * cwnd_segs;
+    }
+
+    // TCP-friendly region: never grow slower than Reno would
+    c->w_est += 3.0 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * acked_segs / cwnd_segs;
+    if (c->w_est > target) {
+        target = c->w_est;
+    }
+
+    if (target > cwnd_segs) {
+        cc->cwnd_acc += (uint32_t)((target - cwnd_segs) / cwnd_segs * acked_segs * cc->mss);
+        if (cc->cwnd_acc >= cc->mss) {
+            cc->cwnd += cc->cwnd_acc;
+            cc->cwnd_acc = 0;
+        }
+    }
+}
+
+// Remember where loss happened; release some of it early if the window is
+// still below the previous maximum (fast convergence)
+static void cubic_reduce(struct cc_state *cc) {
+    struct cubic_state *c = &cc->u.cubic;
+    double cwnd_segs = (double)cc->cwnd / cc->mss;
+
+    c->epoch_start_us = 0;
+    if (cwnd_segs < c->w_max) {
+        c->w_max = cwnd_segs * (1 + CUBIC_BETA) / 2;
+    } else {
+        c->w_max = cwnd_segs;
+    }
+    cc->ssthresh = max_u32((uint32_t)(cc->cwnd * CUBIC_BETA), CC_MIN_CWND_SEGS * cc->mss);
+    cc->cwnd_acc = 0;
+}
+
+static void cubic_on_loss(struct cc_state *cc, uint32_t bytes_in_flight) {
+    cubic_reduce(cc);
+    cc->cwnd = cc->ssthresh;
+}
+
+static void cubic_on_timeout(struct cc_state *cc, uint32_t bytes_in_flight) {
+    cubic_reduce(cc);
+    cc->cwnd = cc->mss;
+}
+
+// ---------------------------------------------------------------------------
+// BBR-style delay-based control: model the path as bottleneck bandwidth and
+// minimum RTT, and size the window to a multiple of their product instead of
+// reacting to individual losses
+// ---------------------------------------------------------------------------
+
+#define BBR_HIGH_GAIN 2.885        // 2/ln(2): doubles delivery rate each round
+#define BBR_CWND_GAIN 2.0
+#define BBR_MIN_RTT_WIN_US 10000000 // Refresh min RTT at least every 10s
+#define BBR_PROBE_RTT_US 200000    // Time spent at minimal window in PROBE_RTT
+#define BBR_MIN_CWND_SEGS 4
+
+static const double bbr_cycle_gains[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+#define BBR_CYCLE_LEN (int)(sizeof(bbr_cycle_gains) / sizeof(bbr_cycle_gains[0]))
+
+static void bbr_init(struct cc_state *cc) {
+    struct bbr_state *b = &cc->u.bbr;
+    memset(b, 0, sizeof(*b));
+    b->mode = BBR_STARTUP;
+    b->min_rtt_us = UINT32_MAX;
+    b->pacing_gain = BBR_HIGH_GAIN;
+    b->cwnd_gain = BBR_HIGH_GAIN;
+}
+
+// Windowed max of the per-round delivery rate (bytes/us)
+static double bbr_max_bw(struct bbr_state *b) {
+    double bw = 0;
+    for (int i = 0; i < BBR_BW_WINDOW; i++) {
+        if (b->bw_samples[i] > bw) bw = b->bw_samples[i];
+    }
+    return bw;
+}
+
+// Estimated bandwidth-delay product in bytes, 0 while the model is empty
+static uint32_t bbr_bdp(struct bbr_state *b) {
+    double bw = bbr_max_bw(b);
+    if (bw <= 0 || b->min_rtt_us == UINT32_MAX) return 0;
+    return (uint32_t)(bw * b->min_rtt_us);
+}
+
+// Advance the state machine once per round trip
+static void bbr_on_round(struct cc_state *cc, uint32_t bytes_in_flight, uint64_t now) {
+    struct bbr_state *b = &cc->u.bbr;
+    double bw = bbr_max_bw(b);
+
+    switch (b->mode) {
+    case BBR_STARTUP:
+        // The pipe is full once bandwidth stops growing by 25% per round
+        if (bw >= b->full_bw * 1.25) {
+            b->full_bw = bw;
+            b->full_bw_rounds = 0;
+        } else if (++b->full_bw_rounds >= 3) {
+            b->mode = BBR_DRAIN;
+            b->pacing_gain = 1 / BBR_HIGH_GAIN;
+            b->cwnd_gain = BBR_HIGH_GAIN;
+        }
+        break;
+    case BBR_DRAIN:
+        if (bytes_in_flight <= bbr_bdp(b)) {
+            b->mode = BBR_PROBE_BW;
+            b->cycle_index = 0;
+            b->pacing_gain = bbr_cycle_gains[0];
+            b->cwnd_gain = BBR_CWND_GAIN;
+        }
+        break;
+    case BBR_PROBE_BW:
+        b->cycle_index = (b->cycle_index + 1) % BBR_CYCLE_LEN;
+        b->pacing_gain = bbr_cycle_gains[b->cycle_index];
+        break;
+    case BBR_PROBE_RTT:
+        if (now >= b->probe_rtt_done_us) {
+            b->min_rtt_stamp_us = now;
+            b->mode = BBR_PROBE_BW;
+            b->cycle_index = 0;
+            b->pacing_gain = bbr_cycle_gains[0];
+            b->cwnd_gain = BBR_CWND_GAIN;
+        }
+        break;
+    }
+
+    // Drain the queue briefly when the min RTT estimate has gone stale
+    if (b->mode != BBR_PROBE_RTT && b->mode != BBR_STARTUP &&
+        now - b->min_rtt_stamp_us > BBR_MIN_RTT_WIN_US) {
+        b->mode = BBR_PROBE_RTT;
+        b->pacing_gain = 1;
+        b->probe_rtt_done_us = now + BBR_PROBE_RTT_US;
+        b->min_rtt_us = UINT32_MAX;
+    }
+}
+
+static void bbr_on_ack(struct cc_state *cc, const struct cc_ack *ack) {
+    struct bbr_state *b = &cc->u.bbr;
+    uint64_t now = cc_now_us();
+
+    b->delivered += ack->acked_bytes;
+    if (ack->rtt_us && (ack->rtt_us <= b->min_rtt_us || now - b->min_rtt_stamp_us > BBR_MIN_RTT_WIN_US)) {
+        b->min_rtt_us = ack->rtt_us;
+        b->min_rtt_stamp_us = now;
+    }
+
+    // A round ends once everything in flight at its start has been delivered
+    if (b->delivered >= b->round_target) {
+        if (b->round_start_us && now > b->round_start_us) {
+            double rate = (double)(b->delivered - b->round_start_delivered) / (now - b->round_start_us);
+            b->bw_samples[b->round_count % BBR_BW_WINDOW] = rate;
+            b->round_count++;
+            bbr_on_round(cc, ack->bytes_in_flight, now);
+        }
+        b->round_start_us = now;
+        b->round_start_delivered = b->delivered;
+        b->round_target = b->delivered + max_u32(ack->bytes_in_flight, 1);
+    }
+
+    uint32_t floor = BBR_MIN_CWND_SEGS * cc->mss;
+    if (b->mode == BBR_PROBE_RTT) {
+        cc->cwnd = floor;
+        return;
+    }
+
+    uint32_t bdp = bbr_bdp(b);
+    uint32_t target = max_u32((uint32_t)(b->cwnd_gain * bdp), floor);
+    if (b->mode == BBR_STARTUP || bdp == 0) {
+        // Grow exponentially until the model is primed
+        cc->cwnd = max_u32(cc->cwnd + ack->acked_bytes, target);
+    } else if (cc->cwnd < target) {
+        cc->cwnd = cc->cwnd + ack->acked_bytes < target ? cc->cwnd + ack->acked_bytes : target;
+    } else {
+        cc->cwnd = target;
+    }
+}
+
+static void bbr_on_loss(struct cc_state *cc, uint32_t bytes_in_flight) {
+    // Isolated losses are not a congestion signal for a model-based sender
+}
+
+static void bbr_on_timeout(struct cc_state *cc, uint32_t bytes_in_flight) {
+    // Collapse the window; the model lets it regrow to the BDP within a round
+    cc->cwnd = cc->mss;
+}
+
+// Pace at the gain of the current phase times the bottleneck bandwidth;
+// until a round has measured it, spread the window over the RTT
+static uint64_t bbr_pacing_rate(struct cc_state *cc, uint32_t srtt_us) {
+    struct bbr_state *b = &cc->u.bbr;
+    double bw = bbr_max_bw(b);
+    if (bw <= 0) {
+        return srtt_us ? (uint64_t)(b->pacing_gain * cc->cwnd * 1000000.0 / srtt_us) : 0;
+    }
+    return (uint64_t)(b->pacing_gain * bw * 1000000.0);
+}
+
+// ---------------------------------------------------------------------------
+// Registry and dispatch
+// ---------------------------------------------------------------------------
+
+static const struct cc_ops cc_algorithms[] = {
+    {"reno",  reno_init,  reno_on_ack,  reno_on_loss,  reno_on_timeout,  window_pacing_rate},
+    {"cubic", cubic_init, cubic_on_ack, cubic_on_loss, cubic_on_timeout, window_pacing_rate},
+    {"bbr",   bbr_init,   bbr_on_ack,   bbr_on_loss,   bbr_on_timeout,   bbr_pacing_rate},
+};
+#define CC_NUM_ALGORITHMS (int)(sizeof(cc_algorithms) / sizeof(cc_algorithms[0]))
+
+// Look up an algorithm by name
+const struct cc_ops *cc_lookup(const char *name) {
+    for (int i = 0; i < CC_NUM_ALGORITHMS; i++) {
+        if (strcmp(cc_algorithms[i].name, name) == 0) {
+            return &cc_algorithms[i];
+        }
+    }
+    return NULL;
+}
+
+// Comma-separated list of available algorithms
+const char *cc_available(void) {
+    static char names[64];
+    if (names[0] == '\0') {
+        for (int i = 0; i < CC_NUM_ALGORITHMS; i++) {
+            if (i > 0) strcat(names, ", ");
+            strcat(names, cc_algorithms[i].name);
+        }
+    }
+    return names;
+}
+
+// Keep the window between one segment and what the sender can track
+static void clamp_cwnd(struct cc_state *cc) {
+    if (cc->cwnd < cc->mss) cc->cwnd = cc->mss;
+    if (cc->cwnd > cc->max_cwnd) cc->cwnd = cc->max_cwnd;
+}
+
+// Start with an initial window of initial_segs segments
+void cc_init(struct cc_state *cc, const struct cc_ops *ops, uint32_t mss,
+             uint32_t initial_segs, uint32_t max_cwnd) {
+    memset(cc, 0, sizeof(*cc));
+    cc->ops = ops;
+    cc->mss = mss;
+    cc->cwnd = initial_segs * mss;
+    cc->ssthresh = CC_INITIAL_SSTHRESH;
+    cc->max_cwnd = max_cwnd;
+    ops->init(cc);
+    clamp_cwnd(cc);
+}
+
+void cc_on_ack(struct cc_state *cc, const struct cc_ack *ack) {
+    cc->ops->on_ack(cc, ack);
+    clamp_cwnd(cc);
+}
+
+void cc_on_loss(struct cc_state *cc, uint32_t bytes_in_flight) {
+    cc->loss_events++;
+    cc->ops->on_loss(cc, bytes_in_flight);
+    clamp_cwnd(cc);
+}
+
+void cc_on_timeout(struct cc_state *cc, uint32_t bytes_in_flight) {
+    cc->timeouts++;
+    cc->ops->on_timeout(cc, bytes_in_flight);
+    clamp_cwnd(cc);
+}
+
+uint64_t cc_pacing_rate(struct cc_state *cc, uint32_t srtt_us) {
+    return cc->ops->pacing_rate(cc, srtt_us);
+}
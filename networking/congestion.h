@@ -0,0 +1,101 @@
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Congestion Control Constants
+#define CC_DEFAULT "cubic"         // Algorithm used when none is selected
+#define CC_MIN_CWND_SEGS 2         // Floor for loss responses (segments)
+#define CC_INITIAL_SSTHRESH 0xffffffffu
+#define CC_PACING_SS_GAIN 2.0      // Pacing rate over cwnd/SRTT in slow start
+#define CC_PACING_CA_GAIN 1.2      // ... and in congestion avoidance
+
+struct cc_state;
+
+// ACK Event: what the sender learned from one cumulative ACK
+struct cc_ack {
+    uint32_t acked_bytes;          // Bytes newly acknowledged
+    uint32_t rtt_us;               // RTT sample, or 0 if Karn's rule skipped it
+    uint32_t bytes_in_flight;      // Outstanding bytes after this ACK
+};
+
+// Congestion Control Operations: one table per algorithm
+struct cc_ops {
+    const char *name;
+    void (*init)(struct cc_state *cc);
+    void (*on_ack)(struct cc_state *cc, const struct cc_ack *ack);
+    void (*on_loss)(struct cc_state *cc, uint32_t bytes_in_flight);     // Hole reported by SACK
+    void (*on_timeout)(struct cc_state *cc, uint32_t bytes_in_flight);  // Retransmission timer expired
+    uint64_t (*pacing_rate)(struct cc_state *cc, uint32_t srtt_us);     // Bytes per second, 0 if unknown
+};
+
+// Per-algorithm state
+struct cubic_state {
+    double w_max;                  // Window before the last reduction (segments)
+    double k;                      // Time to climb back to w_max (seconds)
+    uint64_t epoch_start_us;       // Start of the current growth epoch, 0 if none
+    double w_est;                  // Reno-equivalent window for the TCP-friendly region
+    uint32_t min_rtt_us;
+};
+
+typedef enum {
+    BBR_STARTUP,
+    BBR_DRAIN,
+    BBR_PROBE_BW,
+    BBR_PROBE_RTT
+} bbr_mode_t;
+
+#define BBR_BW_WINDOW 10           // Rounds covered by the bandwidth max filter
+
+struct bbr_state {
+    bbr_mode_t mode;
+    double bw_samples[BBR_BW_WINDOW];  // Per-round delivery rates (bytes/us)
+    uint32_t round_count;
+    uint64_t delivered;            // Bytes delivered since the connection began
+    uint64_t round_start_delivered;
+    uint64_t round_target;         // delivered value that ends the current round
+    uint64_t round_start_us;
+    double full_bw;                // Bandwidth plateau detection for STARTUP
+    int full_bw_rounds;
+    uint32_t min_rtt_us;
+    uint64_t min_rtt_stamp_us;
+    uint64_t probe_rtt_done_us;
+    int cycle_index;               // Position in the PROBE_BW gain cycle
+    double pacing_gain;
+    double cwnd_gain;
+};
+
+// Congestion Control State
+struct cc_state {
+    const struct cc_ops *ops;
+    uint32_t mss;                  // Segment size (bytes)
+    uint32_t cwnd;                 // Congestion window (bytes)
+    uint32_t ssthresh;             // Slow start threshold (bytes)
+    uint32_t max_cwnd;             // Largest window the sender can track (bytes)
+    uint32_t cwnd_acc;             // Congestion avoidance byte counter
+    uint32_t loss_events;
+    uint32_t timeouts;
+    union {
+        struct cubic_state cubic;
+        struct bbr_state bbr;
+    } u;
+};
+
+// Look up an algorithm by name ("reno", "cubic", "bbr"); NULL if unknown
+const struct cc_ops *cc_lookup(const char *name);
+
+// Comma-separated list of available algorithms, for usage messages
+const char *cc_available(void);
+
+void cc_init(struct cc_state *cc, const struct cc_ops *ops, uint32_t mss,
+             uint32_t initial_segs, uint32_t max_cwnd);
+void cc_on_ack(struct cc_state *cc, const struct cc_ack *ack);
+void cc_on_loss(struct cc_state *cc, uint32_t bytes_in_flight);
+void cc_on_timeout(struct cc_state *cc, uint32_t bytes_in_flight);
+
+// Rate to pace transmissions at, in bytes per second; 0 until there is an
+// RTT sample to base it on
+uint64_t cc_pacing_rate(struct cc_state *cc, uint32_t srtt_us);
+
+#endif // CONGESTION_H
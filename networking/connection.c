@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include "connection.h"
+
+// Mix address and port into a bucket index (Fibonacci hashing)
+static uint32_t conn_hash(const struct sockaddr_in *addr, uint32_t num_buckets) {
+    uint64_t key = ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (num_buckets - 1);
+}
+
+static bool same_peer(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+int conn_table_init(struct conn_table *t, uint32_t first_id, uint32_t id_stride) {
+    t->num_buckets = CONN_TABLE_INITIAL_BUCKETS;
+    t->count = 0;
+    t->next_id = first_id;
+    t->id_stride = id_stride;
+    t->buckets = calloc(t->num_buckets, sizeof(*t->buckets));
+    return t->buckets ? 0 : -1;
+}
+
+// Free every connection still in the table
+void conn_table_free(struct conn_table *t) {
+    for (uint32_t i = 0; i < t->num_buckets; i++) {
+        struct connection *c = t->buckets[i];
+        while (c) {
+            struct connection *next = c->hash_next;
+            free(c);
+            c = next;
+        }
+    }
+    free(t->buckets);
+    t->buckets = NULL;
+    t->count = 0;
+}
+
+// Rehash into twice as many buckets; on allocation failure the table
+// keeps working with longer chains
+static void conn_table_grow(struct conn_table *t) {
+    uint32_t num_buckets = t->num_buckets * 2;
+    struct connection **buckets = calloc(num_buckets, sizeof(*buckets));
+    if (!buckets) return;
+
+    for (uint32_t i = 0; i < t->num_buckets; i++) {
+        struct connection *c = t->buckets[i];
+        while (c) {
+            struct connection *next = c->hash_next;
+            uint32_t b = conn_hash(&c->addr, num_buckets);
+            c->hash_next = buckets[b];
+            buckets[b] = c;
+            c = next;
+        }
+    }
+    free(t->buckets);
+    t->buckets = buckets;
+    t->num_buckets = num_buckets;
+}
+
+struct connection *conn_lookup(struct conn_table *t, const struct sockaddr_in *addr) {
+    struct connection *c = t->buckets[conn_hash(addr, t->num_buckets)];
+    while (c && !same_peer(&c->addr, addr)) {
+        c = c->hash_next;
+    }
+    return c;
+}
+
+struct connection *conn_create(struct conn_table *t, const struct sockaddr_in *addr) {
+    struct connection *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+
+    c->addr = *addr;
+    c->id = t->next_id;
+    t->next_id += t->id_stride;
+    c->state = STATE_CLOSED;
+    c->receiver_window = 65535;
+    c->digest_alg = DIGEST_MD5;
+    c->writer.fd = -1;
+    c->last_activity_ms = timer_now_ms();
+
+    if (t->count >= t->num_buckets) {
+        conn_table_grow(t);
+    }
+    uint32_t b = conn_hash(addr, t->num_buckets);
+    c->hash_next = t->buckets[b];
+    t->buckets[b] = c;
+    t->count++;
+    return c;
+}
+
+void conn_destroy(struct conn_table *t, struct connection *c) {
+    struct connection **link = &t->buckets[conn_hash(&c->addr, t->num_buckets)];
+    while (*link && *link != c) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = c->hash_next;
+        t->count--;
+    }
+    free(c);
+}
@@ -0,0 +1,110 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include "sham.h"
+#include "reassembly.h"
+#include "writer.h"
+#include "digest.h"
+#include "timer_wheel.h"
+#include "transfer.h"
+#include "checkpoint.h"
+#include "compress.h"
+#include "fec.h"
+
+// Connection Table Constants
+#define CONN_TABLE_INITIAL_BUCKETS 64   // Power of two; doubles as the table fills
+#define SHAM_MAX_CONNECTIONS 4096       // Concurrent connections the server accepts
+#define CONN_SOCKET_BUFFER (8 * 1024 * 1024)  // Receive buffer requested for each server socket
+
+// Connection Timers
+#define CONN_HANDSHAKE_TIMEOUT_MS 10000 // SYN-ACK sent, final ACK never came
+#define CONN_IDLE_TIMEOUT_MS 120000     // Established peer silent this long is gone
+#define CONN_LINGER_MS 2000             // Wait for the final ACK after our FIN
+
+// Delayed ACK Defaults: in-order data is acknowledged every ACK_EVERY
+// segments, or ACK_DELAY_MS after the first unacknowledged one. The SYN-ACK
+// tells the sender the delay, which it adds to its RTO.
+#define ACK_EVERY_DEFAULT 2
+#define ACK_DELAY_DEFAULT_MS 5
+
+// Receiver Connection: everything the server keeps for one client, from the
+// SYN to the final ACK. Buffers are only allocated once the handshake
+// completes, so half-open connections cost just this struct.
+struct connection {
+    struct sockaddr_in addr;       // Peer address, the table key
+    uint32_t id;
+    connection_state_t state;
+    uint64_t last_activity_ms;     // Last datagram from the peer (timer_now_ms)
+    struct timer idle_timer;       // Handshake, idle or linger deadline
+    struct timer ack_timer;        // Delayed ACK deadline
+    uint32_t unacked_segments;     // In-order segments since the last ACK
+
+    uint32_t next_expected_seq;
+    uint32_t data_start_seq;
+    uint32_t mss;                  // Segment size granted in the SYN-ACK
+    uint32_t receiver_window;      // Advertised window in bytes, refreshed per ACK
+    uint8_t wscale;                // Shift applied to it on the wire; 0 unless the client offered scaling
+    uint64_t expected_file_size;   // From the SYN, 0 if not announced
+    char output_filename[64];
+    
+    // One stream of a parallel transfer, writing its range of the shared file
+    struct transfer *transfer;     // NULL for an ordinary connection
+    struct sham_stream_opt stream;
+    
+    // Resumable transfer: progress is checkpointed next to the output file
+    bool resumable;
+    uint64_t resume_id;
+    uint64_t resume_offset;        // File bytes restored from a checkpoint
+    uint64_t checkpointed;         // Stream bytes covered by the last checkpoint
+    
+    // Payload compression agreed in the handshake; COMPRESS_NONE if off
+    compress_alg_t compress_alg;
+    struct compress_stats compress_stats;
+    
+    // Forward error correction agreed in the handshake; 0 if off
+    uint8_t fec;
+    struct fec_decoder fec_rx;     // Recent segments, to rebuild a lost one from parity
+    bool fec_rebuilt;              // A segment was rebuilt since the last ACK
+
+    struct reassembly reasm;       // Segments held out of order
+    struct file_writer writer;     // In-order data streams straight to the file
+
+    // End-to-end digest of the delivered stream, checked against the sender's at FIN
+    digest_alg_t digest_alg;
+    struct digest rx_digest;
+    uint8_t rx_digest_value[DIGEST_MAX_LENGTH];
+    uint8_t sender_digest[DIGEST_MAX_LENGTH];
+    bool sender_digest_present;
+    bool digest_verified;
+
+    struct connection *hash_next;  // Bucket chain
+};
+
+// Connection Table: connections hashed by peer address and port, chained
+// per bucket. The bucket array doubles when the load factor passes 1.
+struct conn_table {
+    struct connection **buckets;
+    uint32_t num_buckets;
+    uint32_t count;
+    uint32_t next_id;              // Id for the next connection
+    uint32_t id_stride;            // Step between ids, so tables never share one
+};
+
+// Ids handed out are first_id, first_id + id_stride, ...
+int conn_table_init(struct conn_table *t, uint32_t first_id, uint32_t id_stride);
+void conn_table_free(struct conn_table *t);
+
+// Find the connection for a peer; NULL if there is none
+struct connection *conn_lookup(struct conn_table *t, const struct sockaddr_in *addr);
+
+// Allocate a connection in STATE_CLOSED for a peer and add it to the table
+struct connection *conn_create(struct conn_table *t, const struct sockaddr_in *addr);
+
+// Unlink a connection and free it; its buffers must already be released
+void conn_destroy(struct conn_table *t, struct connection *c);
+
+#endif // CONNECTION_H
@@ -0,0 +1,178 @@
+#include <string.h>
+#include <stdbool.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define CRC32C_X86 1
+#endif
+
+static uint32_t crc32c_first_use(uint32_t crc, const void *data, size_t len);
+
+static uint32_t table[8][256];     // Slicing-by-8: table[k][b] is b followed by k zero bytes
+static crc32c_fn active = crc32c_first_use;
+
+static struct crc32c_impl impls[3];
+static int num_impls = 0;
+
+// Multiply two reflected polynomials modulo the CRC polynomial (after zlib)
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^n modulo the CRC polynomial; x^0 is the top bit when reflected
+static uint32_t xpow(uint64_t n) {
+    uint32_t result = 1u << 31;
+    uint32_t square = 1u << 30;
+    for (; n > 0; n >>= 1) {
+        if (n & 1) result = multmodp(result, square);
+        square = multmodp(square, square);
+    }
+    return result;
+}
+
+static void build_tables(void) {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; i++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        for (int k = 1; k < 8; k++) {
+            table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+        }
+    }
+}
+
+static uint32_t crc32c_portable(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff] ^
+              table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24] ^
+              table[3][p[4]] ^ table[2][p[5]] ^ table[1][p[6]] ^ table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+    }
+    return ~crc;
+}
+
+#ifdef CRC32C_X86
+
+// Multipliers that shift a lane's CRC past the lanes after it: x^(8n - 33)
+// for n bytes, the 33 making up for the product's one-bit offset and the
+// x^32 the crc32 instruction applies when reducing it
+static uint32_t shift_long1, shift_long2, shift_short1, shift_short2;
+
+__attribute__((target("sse4.2")))
+static uint64_t crc32c_words(uint64_t crc, const uint8_t *p, size_t len) {
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = _mm_crc32_u64(crc, v);
+    }
+    for (; len > 0; len--) {
+        crc = _mm_crc32_u8((uint32_t)crc, *p++);
+    }
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const void *data, size_t len) {
+    return ~(uint32_t)crc32c_words(~crc, data, len);
+}
+
+// crc * x^(8n) modulo the polynomial, given shift = x^(8n - 33)
+__attribute__((target("sse4.2,pclmul")))
+static uint64_t crc32c_shift(uint64_t crc, uint32_t shift) {
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi64_si128((int64_t)crc),
+                                           _mm_cvtsi32_si128((int)shift), 0);
+    return _mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(product));
+}
+
+// Three lanes of n bytes: the first carries the CRC so far, the others
+// start from zero, and the three are combined as if run one after another
+__attribute__((target("sse4.2,pclmul")))
+static uint64_t crc32c_lanes(uint64_t crc, const uint8_t *p, size_t n, uint32_t shift1, uint32_t shift2) {
+    uint64_t crc1 = 0, crc2 = 0;
+    for (size_t i = 0; i < n; i += 8) {
+        uint64_t v0, v1, v2;
+        memcpy(&v0, p + i, sizeof(v0));
+        memcpy(&v1, p + n + i, sizeof(v1));
+        memcpy(&v2, p + 2 * n + i, sizeof(v2));
+        crc = _mm_crc32_u64(crc, v0);
+        crc1 = _mm_crc32_u64(crc1, v1);
+        crc2 = _mm_crc32_u64(crc2, v2);
+    }
+    return crc32c_shift(crc, shift2) ^ crc32c_shift(crc1, shift1) ^ crc2;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crc32c_pclmul(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint64_t c = ~crc;
+    for (; len >= 3 * CRC32C_LONG; p += 3 * CRC32C_LONG, len -= 3 * CRC32C_LONG) {
+        c = crc32c_lanes(c, p, CRC32C_LONG, shift_long1, shift_long2);
+    }
+    for (; len >= 3 * CRC32C_SHORT; p += 3 * CRC32C_SHORT, len -= 3 * CRC32C_SHORT) {
+        c = crc32c_lanes(c, p, CRC32C_SHORT, shift_short1, shift_short2);
+    }
+    return ~(uint32_t)crc32c_words(c, p, len);
+}
+
+#endif
+
+const char *crc32c_init(void) {
+    if (num_impls > 0) {
+        return impls[num_impls - 1].name;
+    }
+    build_tables();
+    impls[num_impls++] = (struct crc32c_impl){ "portable", crc32c_portable };
+#ifdef CRC32C_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        impls[num_impls++] = (struct crc32c_impl){ "sse4.2", crc32c_sse42 };
+        if (__builtin_cpu_supports("pclmul")) {
+            shift_long1 = xpow(8 * CRC32C_LONG - 33);
+            shift_long2 = xpow(16 * CRC32C_LONG - 33);
+            shift_short1 = xpow(8 * CRC32C_SHORT - 33);
+            shift_short2 = xpow(16 * CRC32C_SHORT - 33);
+            impls[num_impls++] = (struct crc32c_impl){ "pclmul", crc32c_pclmul };
+        }
+    }
+#endif
+    active = impls[num_impls - 1].fn;
+    return impls[num_impls - 1].name;
+}
+
+int crc32c_implementations(const struct crc32c_impl **list) {
+    crc32c_init();
+    *list = impls;
+    return num_impls;
+}
+
+static uint32_t crc32c_first_use(uint32_t crc, const void *data, size_t len) {
+    crc32c_init();
+    return active(crc, data, len);
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    return active(crc, data, len);
+}
@@ -0,0 +1,40 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC32C Constants
+#define CRC32C_POLY 0x82F63B78u    // Castagnoli polynomial, bit-reflected
+#define CRC32C_LONG 1024           // Bytes per lane in the three-lane kernel's long rounds
+#define CRC32C_SHORT 128           // ...and in its short rounds
+
+// CRC-32C, the checksum of iSCSI, SCTP and ext4. It has better error
+// detection than the CRC-32 of Ethernet and zlib, and x86 computes it in
+// hardware. Implementations, slowest first:
+//
+// - portable: slicing-by-8 tables, eight bytes per step
+// - sse4.2:   the crc32 instruction, eight bytes per step, but each step
+//             waits for the last, so it runs at a third of its throughput
+// - pclmul:   crc32 on three lanes at once, whose CRCs are then shifted
+//             into place with a carry-less multiply and combined
+//
+// crc32c_init() picks the fastest one the CPU supports.
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const void *data, size_t len);
+
+struct crc32c_impl {
+    const char *name;
+    crc32c_fn fn;
+};
+
+// Select the implementation for crc32c(); returns its name. Call once
+// before starting threads; a crc32c() before it selects on first use.
+const char *crc32c_init(void);
+
+// Implementations this CPU can run, slowest first; returns how many
+int crc32c_implementations(const struct crc32c_impl **impls);
+
+// Extend crc (0 to start) over len bytes of data
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif // CRC32C_H
@@ -0,0 +1,197 @@
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include "digest.h"
+
+// XXH64 (public domain algorithm by Yann Collet), seed 0
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Input is read little-endian whatever the host order
+static uint64_t read_le64(const uint8_t *p) {
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+           (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static uint64_t xxh64_merge_round(uint64_t acc, uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static void xxh64_init(struct xxh64_state *s) {
+    memset(s, 0, sizeof(*s));
+    s->v[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+    s->v[1] = XXH_PRIME64_2;
+    s->v[2] = 0;
+    s->v[3] = -XXH_PRIME64_1;
+}
+
+// Consume one 32-byte stripe, 8 bytes per lane
+static void xxh64_stripe(struct xxh64_state *s, const uint8_t *p) {
+    for (int i = 0; i < 4; i++) {
+        s->v[i] = xxh64_round(s->v[i], read_le64(p + 8 * i));
+    }
+}
+
+static void xxh64_update(struct xxh64_state *s, const uint8_t *p, size_t len) {
+    s->total_len += len;
+
+    // Top up a partial stripe left by the previous call
+    if (s->mem_size > 0) {
+        size_t fill = 32 - s->mem_size;
+        if (len < fill) {
+            memcpy(s->mem + s->mem_size, p, len);
+            s->mem_size += len;
+            return;
+        }
+        memcpy(s->mem + s->mem_size, p, fill);
+        xxh64_stripe(s, s->mem);
+        p += fill;
+        len -= fill;
+        s->mem_size = 0;
+    }
+
+    while (len >= 32) {
+        xxh64_stripe(s, p);
+        p += 32;
+        len -= 32;
+    }
+
+    memcpy(s->mem, p, len);
+    s->mem_size = len;
+}
+
+static uint64_t xxh64_digest(const struct xxh64_state *s) {
+    uint64_t h;
+    if (s->total_len >= 32) {
+        h = rotl64(s->v[0], 1) + rotl64(s->v[1], 7) + rotl64(s->v[2], 12) + rotl64(s->v[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = xxh64_merge_round(h, s->v[i]);
+        }
+    } else {
+        h = s->v[2] + XXH_PRIME64_5;
+    }
+    h += s->total_len;
+
+    // Tail: whatever did not fill a stripe
+    const uint8_t *p = s->mem;
+    size_t len = s->mem_size;
+    while (len >= 8) {
+        h ^= xxh64_round(0, read_le64(p));
+        h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t)read_le32(p) * XXH_PRIME64_1;
+        h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        h ^= *p * XXH_PRIME64_5;
+        h = rotl64(h, 11) * XXH_PRIME64_1;
+        p++;
+        len--;
+    }
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Algorithm lookup
+digest_alg_t digest_lookup(const char *name) {
+    if (strcasecmp(name, "md5") == 0) return DIGEST_MD5;
+    if (strcasecmp(name, "xxh64") == 0) return DIGEST_XXH64;
+    return 0;
+}
+
+const char *digest_name(digest_alg_t alg) {
+    switch (alg) {
+    case DIGEST_MD5: return "MD5";
+    case DIGEST_XXH64: return "XXH64";
+    }
+    return NULL;
+}
+
+size_t digest_length(digest_alg_t alg) {
+    switch (alg) {
+    case DIGEST_MD5: return MD5_DIGEST_LENGTH;
+    case DIGEST_XXH64: return sizeof(uint64_t);
+    }
+    return 0;
+}
+
+const char *digest_available(void) {
+    return "md5, xxh64";
+}
+
+void digest_init(struct digest *d, digest_alg_t alg) {
+    d->alg = alg;
+    if (alg == DIGEST_XXH64) {
+        xxh64_init(&d->u.xxh64);
+    } else {
+        MD5_Init(&d->u.md5);
+    }
+}
+
+void digest_update(struct digest *d, const void *data, size_t len) {
+    if (d->alg == DIGEST_XXH64) {
+        xxh64_update(&d->u.xxh64, data, len);
+    } else {
+        MD5_Update(&d->u.md5, data, len);
+    }
+}
+
+size_t digest_final(struct digest *d, uint8_t *out) {
+    if (d->alg == DIGEST_XXH64) {
+        // Canonical form is big-endian, matching xxhsum output
+        uint64_t h = xxh64_digest(&d->u.xxh64);
+        for (int i = 0; i < 8; i++) {
+            out[i] = (uint8_t)(h >> (56 - 8 * i));
+        }
+        return 8;
+    }
+    MD5_Final(out, &d->u.md5);
+    return MD5_DIGEST_LENGTH;
+}
+
+size_t digest_combine(digest_alg_t alg, const uint8_t (*range_digests)[DIGEST_MAX_LENGTH],
+                      int num_ranges, uint8_t *out) {
+    struct digest d;
+    size_t len = digest_length(alg);
+    digest_init(&d, alg);
+    for (int i = 0; i < num_ranges; i++) {
+        digest_update(&d, range_digests[i], len);
+    }
+    return digest_final(&d, out);
+}
+
+void digest_hex(const uint8_t *digest, size_t len, char *buf) {
+    for (size_t i = 0; i < len; i++) {
+        sprintf(buf + 2 * i, "%02x", digest[i]);
+    }
+    buf[2 * len] = '\0';
+}
@@ -0,0 +1,62 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <openssl/md5.h>
+
+// Digest Constants
+#define DIGEST_DEFAULT "md5"       // Algorithm used when none is selected
+#define DIGEST_MAX_LENGTH 16       // Largest digest any algorithm produces
+
+// End-to-end integrity digests. Both ends feed data in stream order as it
+// is committed, so the digest is ready the moment the last byte is.
+typedef enum {
+    DIGEST_MD5 = 1,
+    DIGEST_XXH64 = 2               // Non-cryptographic, several times faster
+} digest_alg_t;
+
+// XXH64 streaming state
+struct xxh64_state {
+    uint64_t total_len;
+    uint64_t v[4];                 // Lane accumulators
+    uint8_t mem[32];               // Input not yet forming a full stripe
+    uint32_t mem_size;
+};
+
+struct digest {
+    digest_alg_t alg;
+    union {
+        MD5_CTX md5;
+        struct xxh64_state xxh64;
+    } u;
+};
+
+// Look up an algorithm by name ("md5", "xxh64"); 0 if unknown
+digest_alg_t digest_lookup(const char *name);
+
+// Name for messages, "MD5" or "XXH64"; NULL for an unknown algorithm
+const char *digest_name(digest_alg_t alg);
+
+// Digest length in bytes; 0 for an unknown algorithm
+size_t digest_length(digest_alg_t alg);
+
+// Comma-separated list of available algorithms, for usage messages
+const char *digest_available(void);
+
+void digest_init(struct digest *d, digest_alg_t alg);
+void digest_update(struct digest *d, const void *data, size_t len);
+
+// Write the digest to out (digest_length bytes); returns the length
+size_t digest_final(struct digest *d, uint8_t *out);
+
+// Digest of a file sent in ranges: the digest, with the same algorithm, of
+// the concatenated per-range digests in file order. Both ends compute it
+// from digests they already hold, so no pass over the whole file is needed.
+size_t digest_combine(digest_alg_t alg, const uint8_t (*range_digests)[DIGEST_MAX_LENGTH],
+                      int num_ranges, uint8_t *out);
+
+// Format a digest as lowercase hex into buf (2 * len + 1 bytes)
+void digest_hex(const uint8_t *digest, size_t len, char *buf);
+
+#endif // DIGEST_H
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fec.h"
+
+// XOR src into dst, a word at a time
+static void xor_into(uint8_t *dst, const uint8_t *src, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(a));
+    }
+    for (; i < len; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+// Data segments per parity segment for a loss rate
+static uint32_t fec_block_size(double loss) {
+    if (loss * FEC_MAX_BLOCK <= FEC_TARGET_LOSSES) return FEC_MAX_BLOCK;
+    uint32_t block = (uint32_t)(FEC_TARGET_LOSSES / loss);
+    return block < FEC_MIN_BLOCK ? FEC_MIN_BLOCK : block;
+}
+
+int fec_encoder_init(struct fec_encoder *e, uint32_t mss) {
+    memset(e, 0, sizeof(*e));
+    e->parity = malloc(FEC_PARITY_SLOTS * sizeof(struct sham_packet));
+    if (!e->parity) {
+        return -1;
+    }
+    e->mss = mss;
+    e->block = FEC_MAX_BLOCK;
+    return 0;
+}
+
+void fec_encoder_free(struct fec_encoder *e) {
+    free(e->parity);
+    e->parity = NULL;
+}
+
+// The block size is settled when a block starts, so a block and its parity
+// always agree on it
+struct sham_packet *fec_encode(struct fec_encoder *e, const struct sham_header *h,
+                               const uint8_t *payload, uint32_t len, bool last, uint32_t *parity_len) {
+    struct sham_packet *p = &e->parity[e->slot];
+    struct sham_fec_header fh;
+    if (e->count == 0) {
+        e->block = fec_block_size(e->loss);
+        e->max_len = 0;
+        memset(p, 0, SHAM_HEADER_SIZE + SHAM_FEC_HEADER_SIZE + e->mss);
+        p->header.seq_num = h->seq_num;
+        p->header.flags = SHAM_FEC;
+        p->header.window_size = 65535;
+    }
+
+    memcpy(&fh, p->data, sizeof(fh));
+    fh.count++;
+    fh.len_xor ^= (uint16_t)len;
+    fh.flags_xor ^= h->flags & SHAM_COMPRESSED;
+    memcpy(p->data, &fh, sizeof(fh));
+    xor_into(p->data + SHAM_FEC_HEADER_SIZE, payload, len);
+    if (len > e->max_len) e->max_len = len;
+
+    e->loss -= e->loss / FEC_LOSS_HORIZON;
+    e->stats.data_segments++;
+    if (++e->count < e->block && !last) {
+        return NULL;
+    }
+
+    *parity_len = SHAM_FEC_HEADER_SIZE + e->max_len;
+    e->count = 0;
+    e->slot = (e->slot + 1) % FEC_PARITY_SLOTS;
+    e->stats.parity_segments++;
+    e->stats.parity_bytes += *parity_len;
+    return p;
+}
+
+void fec_on_loss(struct fec_encoder *e) {
+    e->loss += (1.0 - e->loss) / FEC_LOSS_HORIZON;
+    e->losses++;
+}
+
+int fec_decoder_init(struct fec_decoder *d, uint32_t start_seq, uint32_t mss) {
+    memset(d, 0, sizeof(*d));
+    d->data = malloc((size_t)FEC_RING_SLOTS * mss);
+    if (!d->data) {
+        return -1;
+    }
+    d->mss = mss;
+    d->start_seq = start_seq;
+    return 0;
+}
+
+void fec_decoder_free(struct fec_decoder *d) {
+    free(d->data);
+    d->data = NULL;
+}
+
+static int fec_slot_index(const struct fec_decoder *d, uint32_t seq) {
+    return ((seq - d->start_seq) / d->mss) % FEC_RING_SLOTS;
+}
+
+void fec_store(struct fec_decoder *d, const struct sham_packet *pkt, uint32_t len) {
+    if (len == 0 || len > d->mss) return;
+    int i = fec_slot_index(d, pkt->header.seq_num);
+    d->slots[i].seq = pkt->header.seq_num;
+    d->slots[i].len = (uint16_t)len;
+    d->slots[i].flags = pkt->header.flags & SHAM_COMPRESSED;
+    d->slots[i].valid = true;
+    memcpy(d->data + (size_t)i * d->mss, pkt->data, len);
+    d->stats.data_segments++;
+}
+
+// A segment missing from the ring may also have been delivered long ago
+// and overwritten since; if it lies behind next_expected it is not rebuilt
+int fec_rebuild(struct fec_decoder *d, const struct sham_packet *parity, uint32_t len,
+                uint32_t next_expected, struct sham_packet *out) {
+    struct sham_fec_header fh;
+    if (len < SHAM_FEC_HEADER_SIZE || len - SHAM_FEC_HEADER_SIZE > d->mss) return -1;
+    memcpy(&fh, parity->data, sizeof(fh));
+    if (fh.count == 0 || fh.count > FEC_MAX_BLOCK) return -1;
+    d->stats.parity_segments++;
+    d->stats.parity_bytes += len;
+
+    uint32_t first = parity->header.seq_num;
+    uint32_t missing_seq = 0;
+    int missing = 0;
+    uint16_t rebuilt_len = fh.len_xor;
+    uint16_t rebuilt_flags = fh.flags_xor;
+    for (uint32_t k = 0; k < fh.count; k++) {
+        uint32_t seq = first + k * d->mss;
+        const struct fec_slot *s = &d->slots[fec_slot_index(d, seq)];
+        if (s->valid && s->seq == seq) {
+            rebuilt_len ^= s->len;
+            rebuilt_flags ^= s->flags;
+        } else {
+            missing_seq = seq;
+            missing++;
+        }
+    }
+    if (missing == 0) return -1;
+    if (missing > 1) {
+        d->stats.unrecoverable++;
+        return -1;
+    }
+    if (seq_lt(missing_seq, next_expected)) return -1;
+    if (rebuilt_len == 0 || rebuilt_len > len - SHAM_FEC_HEADER_SIZE) return -1;
+
+    memcpy(out->data, parity->data + SHAM_FEC_HEADER_SIZE, rebuilt_len);
+    for (uint32_t k = 0; k < fh.count; k++) {
+        uint32_t seq = first + k * d->mss;
+        if (seq == missing_seq) continue;
+        int i = fec_slot_index(d, seq);
+        uint32_t n = d->slots[i].len < rebuilt_len ? d->slots[i].len : rebuilt_len;
+        xor_into(out->data, d->data + (size_t)i * d->mss, n);
+    }
+    memset(&out->header, 0, sizeof(out->header));
+    out->header.seq_num = missing_seq;
+    out->header.flags = rebuilt_flags & SHAM_COMPRESSED;
+    d->stats.rebuilt++;
+    return rebuilt_len;
+}
@@ -0,0 +1,90 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sham.h"
+
+// FEC Constants
+#define FEC_XOR 1                  // Scheme in the FEC option: one XOR parity segment per block
+#define FEC_MIN_BLOCK 2            // Fewest data segments per parity segment (50% overhead)
+#define FEC_MAX_BLOCK 32           // Most data segments per parity segment (3% overhead)
+#define FEC_TARGET_LOSSES 0.25     // Losses per block the block size aims for
+#define FEC_LOSS_HORIZON 256       // Segments the loss estimate averages over
+#define FEC_PARITY_SLOTS 32        // Parity segments queued at once; a full send batch holds at most 22
+#define FEC_RING_SLOTS (2 * FEC_MAX_BLOCK)   // Recent segments the receiver keeps to rebuild from
+
+// Forward error correction for links with random loss. A block of data
+// segments is followed by one XOR parity segment, from which the receiver
+// rebuilds any one segment of the block that went missing, without waiting
+// a round trip for the retransmission. Parity covers the payloads as sent,
+// compressed or not, and is never retransmitted itself.
+
+struct fec_stats {
+    uint64_t data_segments;        // Sent (or received) and covered by parity
+    uint64_t parity_segments;
+    uint64_t parity_bytes;
+    uint64_t rebuilt;              // Segments rebuilt by the receiver
+    uint64_t unrecoverable;        // Blocks that lost more than one segment
+};
+
+// Sender: builds the parity of the current block in one of a ring of
+// packets, so parity already queued on the send batch stays intact until
+// it is flushed. The block size follows an estimate of the loss rate,
+// aiming at FEC_TARGET_LOSSES per block: it then seldom loses two.
+struct fec_encoder {
+    uint32_t mss;
+    struct sham_packet *parity;    // FEC_PARITY_SLOTS packets
+    int slot;                      // The one being built
+    uint32_t block;                // Data segments in the current block
+    uint32_t count;                // ...added so far
+    uint32_t max_len;              // Longest payload among them
+    double loss;                   // Fraction of segments lost, averaged over FEC_LOSS_HORIZON
+    uint64_t losses;               // Loss events counted
+    struct fec_stats stats;
+};
+
+int fec_encoder_init(struct fec_encoder *e, uint32_t mss);
+void fec_encoder_free(struct fec_encoder *e);
+
+// Add a segment to the current block. Returns its parity once the block is
+// complete, or last is set, with the payload length in parity_len; NULL
+// while the block is still open.
+struct sham_packet *fec_encode(struct fec_encoder *e, const struct sham_header *h,
+                               const uint8_t *payload, uint32_t len, bool last, uint32_t *parity_len);
+
+// A segment was lost: retransmitted, or rebuilt from parity by the receiver
+void fec_on_loss(struct fec_encoder *e);
+
+// Receiver: a copy of each recent segment as it arrived, in a ring of
+// slots aligned to the segment size like the reassembly buffer. A parity
+// segment is checked against it once it arrives.
+struct fec_slot {
+    uint32_t seq;
+    uint16_t len;
+    uint16_t flags;                // SHAM_COMPRESSED, if set
+    bool valid;
+};
+
+struct fec_decoder {
+    uint32_t mss;
+    uint32_t start_seq;            // First data byte; slots are aligned to it
+    uint8_t *data;                 // FEC_RING_SLOTS payloads of up to mss bytes
+    struct fec_slot slots[FEC_RING_SLOTS];
+    struct fec_stats stats;
+};
+
+int fec_decoder_init(struct fec_decoder *d, uint32_t start_seq, uint32_t mss);
+void fec_decoder_free(struct fec_decoder *d);
+
+// Keep a copy of a data segment as it came off the wire
+void fec_store(struct fec_decoder *d, const struct sham_packet *pkt, uint32_t len);
+
+// Rebuild the segment of a parity's block that has not arrived into out,
+// header and payload. Returns its payload length, or -1 if there is none
+// to rebuild: the block is complete, has lost more than one segment, or
+// the parity is malformed.
+int fec_rebuild(struct fec_decoder *d, const struct sham_packet *parity, uint32_t len,
+                uint32_t next_expected, struct sham_packet *out);
+
+#endif // FEC_H
@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "timer_wheel.h"
+
+// Network impairment proxy: a UDP relay between S.H.A.M. clients and a
+// server that delays, reorders, duplicates, corrupts and drops datagrams,
+// and squeezes them through a bottleneck, independently in each direction.
+// Clients send to the proxy's port; each client gets a socket of its own
+// towards the server, so the server still sees one peer per client. No
+// root, tc or netem needed.
+
+#define IMPAIR_MAX_FLOWS 64        // Clients relayed at once
+#define IMPAIR_MAX_PENDING 65536   // Datagrams held in flight by the proxy
+#define IMPAIR_MAX_DATAGRAM 65536
+#define IMPAIR_SOCKET_BUFFER (8 * 1024 * 1024)
+#define IMPAIR_FLOW_IDLE_MS 60000  // A client silent this long is forgotten
+#define IMPAIR_REORDER_MS 5        // Default extra hold for a reordered datagram
+#define IMPAIR_QUEUE_KB 1024       // Default bottleneck queue
+
+enum { UP = 0, DOWN = 1 };         // Client to server, server to client
+static const char *direction_name[] = { "client -> server", "server -> client" };
+
+// What one direction does to the datagrams crossing it
+struct impairment {
+    double delay_ms;               // One-way propagation delay
+    double jitter_ms;              // Added to the delay, uniform in [-jitter, +jitter]
+    double loss;                   // Loss rate; in the good state with burst loss
+    double burst_enter;            // Gilbert-Elliott: chance per datagram of entering the bad state
+    double burst_exit;             // ...and of leaving it
+    double burst_loss;             // Loss rate in the bad state
+    double reorder;                // Chance a datagram is held back for reorder_ms
+    double reorder_ms;
+    double duplicate;              // Chance a datagram is delivered twice
+    double corrupt;                // Chance one bit of a datagram is flipped
+    double rate;                   // Bottleneck in bytes per second; 0 for none
+    uint64_t queue_bytes;          // Bytes that may wait for the bottleneck
+};
+
+struct link_stats {
+    uint64_t received;
+    uint64_t delivered;
+    uint64_t bytes;                // Bytes delivered
+    uint64_t lost;                 // Random and burst loss
+    uint64_t burst_lost;           // ...of which in the bad state
+    uint64_t queue_drops;          // Arrived to a full bottleneck queue
+    uint64_t reordered;
+    uint64_t duplicated;
+    uint64_t corrupted;
+};
+
+// One direction: its settings, the Gilbert-Elliott state and the bottleneck
+struct link {
+    struct impairment cfg;
+    bool bad;
+    uint64_t busy_until_us;        // When the bottleneck finishes what it holds
+    struct link_stats stats;
+};
+
+// A client: its address and the socket that speaks for it to the server
+struct flow {
+    struct sockaddr_in addr;
+    int fd;
+    uint64_t last_active_ms;
+};
+
+// A datagram on its way, released at due_us; seq keeps equal times in order
+struct pending {
+    uint64_t due_us;
+    uint64_t seq;
+    int flow;
+    int dir;
+    uint32_t len;
+    uint8_t *data;
+};
+
+static struct link links[2];
+static struct flow flows[IMPAIR_MAX_FLOWS];
+static int num_flows = 0;
+static int listen_fd = -1;
+static struct sockaddr_in server_addr;
+
+static struct pending heap[IMPAIR_MAX_PENDING];
+static int heap_count = 0;
+static uint64_t next_seq = 0;
+static uint64_t pending_overflows = 0;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int sig) {
+    stop_requested = 1;
+}
+
+static double chance(void) {
+    return rand() / ((double)RAND_MAX + 1);
+}
+
+// Min-heap of pending datagrams by release time
+static bool heap_before(const struct pending *a, const struct pending *b) {
+    return a->due_us != b->due_us ? a->due_us < b->due_us : a->seq < b->seq;
+}
+
+static void heap_push(struct pending p) {
+    int i = heap_count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!heap_before(&p, &heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = p;
+}
+
+static struct pending heap_pop(void) {
+    struct pending top = heap[0];
+    struct pending last = heap[--heap_count];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= heap_count) break;
+        if (child + 1 < heap_count && heap_before(&heap[child + 1], &heap[child])) child++;
+        if (!heap_before(&heap[child], &last)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static int open_udp_socket(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int buf = IMPAIR_SOCKET_BUFFER;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The flow for a client, opening one if it is new; -1 if there is no room
+static int flow_for(const struct sockaddr_in *addr, uint64_t now_ms) {
+    for (int i = 0; i < num_flows; i++) {
+        if (flows[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            flows[i].addr.sin_port == addr->sin_port) {
+            flows[i].last_active_ms = now_ms;
+            return i;
+        }
+    }
+    if (num_flows == IMPAIR_MAX_FLOWS) {
+        return -1;
+    }
+    int fd = open_udp_socket(0);
+    if (fd < 0) {
+        return -1;
+    }
+    flows[num_flows].addr = *addr;
+    flows[num_flows].fd = fd;
+    flows[num_flows].last_active_ms = now_ms;
+    printf("Relaying %s:%u\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+    return num_flows++;
+}
+
+// Forget clients gone quiet. A flow is only ever removed with nothing of
+// it still pending, since pending datagrams name flows by index.
+static void expire_flows(uint64_t now_ms) {
+    for (int i = num_flows - 1; i >= 0; i--) {
+        if (now_ms - flows[i].last_active_ms < IMPAIR_FLOW_IDLE_MS) continue;
+        bool busy = false;
+        for (int j = 0; j < heap_count && !busy; j++) {
+            busy = heap[j].flow == i || heap[j].flow == num_flows - 1;
+        }
+        if (busy) continue;
+        close(flows[i].fd);
+        flows[i] = flows[--num_flows];
+    }
+}
+
+static void schedule(int flow, int dir, const uint8_t *data, uint32_t len, uint64_t due_us) {
+    if (heap_count == IMPAIR_MAX_PENDING) {
+        pending_overflows++;
+        return;
+    }
+    uint8_t *copy = malloc(len);
+    if (!copy) {
+        pending_overflows++;
+        return;
+    }
+    memcpy(copy, data, len);
+    struct pending p = { due_us, next_seq++, flow, dir, len, copy };
+    heap_push(p);
+}
+
+// Propagation delay with jitter, and the occasional hold that reorders
+static uint64_t delay_us(struct link *l) {
+    double ms = l->cfg.delay_ms;
+    if (l->cfg.jitter_ms > 0) {
+        ms += (2 * chance() - 1) * l->cfg.jitter_ms;
+    }
+    if (l->cfg.reorder > 0 && chance() < l->cfg.reorder) {
+        ms += l->cfg.reorder_ms;
+        l->stats.reordered++;
+    }
+    return ms > 0 ? (uint64_t)(ms * 1000) : 0;
+}
+
+// Take one datagram through a direction: loss, the bottleneck queue,
+// corruption, then delay, with a duplicate following the same path
+static void impair(int flow, int dir, uint8_t *data, uint32_t len, uint64_t now_us) {
+    struct link *l = &links[dir];
+    l->stats.received++;
+
+    // Gilbert-Elliott: the state moves first, then decides the loss rate
+    double loss = l->cfg.loss;
+    if (l->cfg.burst_enter > 0) {
+        if (l->bad ? chance() < l->cfg.burst_exit : chance() < l->cfg.burst_enter) {
+            l->bad = !l->bad;
+        }
+        if (l->bad) loss = l->cfg.burst_loss;
+    }
+    if (loss > 0 && chance() < loss) {
+        l->stats.lost++;
+        if (l->bad) l->stats.burst_lost++;
+        return;
+    }
+
+    // Bottleneck: datagrams leave one after another at the link rate, and
+    // those that find its queue full are dropped at the tail
+    uint64_t depart_us = now_us;
+    if (l->cfg.rate > 0) {
+        uint64_t start_us = l->busy_until_us > now_us ? l->busy_until_us : now_us;
+        uint64_t backlog = (uint64_t)((start_us - now_us) * l->cfg.rate / 1e6);
+        if (backlog + len > l->cfg.queue_bytes) {
+            l->stats.queue_drops++;
+            return;
+        }
+        depart_us = start_us + (uint64_t)(len * 1e6 / l->cfg.rate);
+        l->busy_until_us = depart_us;
+    }
+
+    if (l->cfg.corrupt > 0 && chance() < l->cfg.corrupt) {
+        data[rand() % len] ^= 1 << (rand() % 8);
+        l->stats.corrupted++;
+    }
+
+    schedule(flow, dir, data, len, depart_us + delay_us(l));
+    if (l->cfg.duplicate > 0 && chance() < l->cfg.duplicate) {
+        schedule(flow, dir, data, len, depart_us + delay_us(l));
+        l->stats.duplicated++;
+    }
+}
+
+// Send every datagram whose time has come
+static void release_due(uint64_t now_us) {
+    while (heap_count > 0 && heap[0].due_us <= now_us) {
+        struct pending p = heap_pop();
+        struct flow *f = &flows[p.flow];
+        ssize_t sent;
+        if (p.dir == UP) {
+            sent = sendto(f->fd, p.data, p.len, 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
+        } else {
+            sent = sendto(listen_fd, p.data, p.len, 0, (struct sockaddr *)&f->addr, sizeof(f->addr));
+        }
+        if (sent >= 0) {
+            links[p.dir].stats.delivered++;
+            links[p.dir].stats.bytes += p.len;
+        }
+        free(p.data);
+    }
+}
+
+// Read a socket until it is empty, passing each datagram to its direction
+static void drain(int fd, int dir, int flow) {
+    static uint8_t buf[IMPAIR_MAX_DATAGRAM];
+    for (;;) {
+        struct sockaddr_in src;
+        socklen_t src_len = sizeof(src);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&src, &src_len);
+        if (n <= 0) {
+            return;
+        }
+        uint64_t now_us = timer_now_us();
+        if (dir == UP) {
+            flow = flow_for(&src, now_us / 1000);
+            if (flow < 0) continue;
+        } else {
+            flows[flow].last_active_ms = now_us / 1000;
+        }
+        impair(flow, dir, buf, (uint32_t)n, now_us);
+    }
+}
+
+static void print_stats(void) {
+    for (int dir = UP; dir <= DOWN; dir++) {
+        const struct link_stats *st = &links[dir].stats;
+        printf("%s: %llu received, %llu delivered (%llu bytes)\n", direction_name[dir],
+               (unsigned long long)st->received, (unsigned long long)st->delivered,
+               (unsigned long long)st->bytes);
+        printf("  lost %llu (%llu in bursts), queue drops %llu, reordered %llu, duplicated %llu, corrupted %llu\n",
+               (unsigned long long)st->lost, (unsigned long long)st->burst_lost,
+               (unsigned long long)st->queue_drops, (unsigned long long)st->reordered,
+               (unsigned long long)st->duplicated, (unsigned long long)st->corrupted);
+    }
+    if (pending_overflows > 0) {
+        printf("Dropped %llu datagrams with the proxy's own queue full\n", (unsigned long long)pending_overflows);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <listen_port> <server_ip> <server_port> [options]\n", prog);
+    fprintf(stderr, "Options apply to both directions; prefix one with up- (client to server)\n");
+    fprintf(stderr, "or down- (server to client), as in --down-loss=0.01, for one only.\n");
+    fprintf(stderr, "  --delay=MS          One-way delay\n");
+    fprintf(stderr, "  --jitter=MS         Vary the delay by up to MS either way\n");
+    fprintf(stderr, "  --loss=P            Drop datagrams with probability P\n");
+    fprintf(stderr, "  --burst=ENTER,EXIT[,LOSS]  Gilbert-Elliott burst loss: chance per datagram of\n");
+    fprintf(stderr, "                      entering and leaving the bad state, loss there (default 1)\n");
+    fprintf(stderr, "  --reorder=P[,MS]    Hold datagrams back MS (default %d) with probability P\n", IMPAIR_REORDER_MS);
+    fprintf(stderr, "  --duplicate=P       Deliver datagrams twice with probability P\n");
+    fprintf(stderr, "  --corrupt=P         Flip a bit with probability P\n");
+    fprintf(stderr, "  --rate=MBIT         Bottleneck bandwidth\n");
+    fprintf(stderr, "  --queue=KB          Bottleneck queue (default %d)\n", IMPAIR_QUEUE_KB);
+    fprintf(stderr, "  --seed=N            Seed the random choices, for repeatable runs\n");
+}
+
+// Parse one impairment option into cfg; -1 if it is not one
+static int parse_option(struct impairment *cfg, const char *name, const char *value) {
+    if (strcmp(name, "delay") == 0) {
+        cfg->delay_ms = atof(value);
+    } else if (strcmp(name, "jitter") == 0) {
+        cfg->jitter_ms = atof(value);
+    } else if (strcmp(name, "loss") == 0) {
+        cfg->loss = atof(value);
+    } else if (strcmp(name, "burst") == 0) {
+        cfg->burst_loss = 1.0;
+        if (sscanf(value, "%lf,%lf,%lf", &cfg->burst_enter, &cfg->burst_exit, &cfg->burst_loss) < 2) {
+            return -1;
+        }
+    } else if (strcmp(name, "reorder") == 0) {
+        cfg->reorder_ms = IMPAIR_REORDER_MS;
+        sscanf(value, "%lf,%lf", &cfg->reorder, &cfg->reorder_ms);
+    } else if (strcmp(name, "duplicate") == 0) {
+        cfg->duplicate = atof(value);
+    } else if (strcmp(name, "corrupt") == 0) {
+        cfg->corrupt = atof(value);
+    } else if (strcmp(name, "rate") == 0) {
+        cfg->rate = atof(value) * 1e6 / 8;
+    } else if (strcmp(name, "queue") == 0) {
+        cfg->queue_bytes = (uint64_t)atoi(value) * 1024;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static void describe(int dir) {
+    const struct impairment *c = &links[dir].cfg;
+    printf("%s: delay %.1f ms, jitter %.1f ms, loss %.2f%%", direction_name[dir],
+           c->delay_ms, c->jitter_ms, c->loss * 100);
+    if (c->burst_enter > 0) {
+        printf(", bursts (enter %.3f, exit %.3f, loss %.0f%%)", c->burst_enter, c->burst_exit, c->burst_loss * 100);
+    }
+    if (c->reorder > 0) printf(", reorder %.2f%% by %.1f ms", c->reorder * 100, c->reorder_ms);
+    if (c->duplicate > 0) printf(", duplicate %.2f%%", c->duplicate * 100);
+    if (c->corrupt > 0) printf(", corrupt %.2f%%", c->corrupt * 100);
+    if (c->rate > 0) printf(", %.1f Mbit/s with a %llu KB queue", c->rate * 8 / 1e6,
+                            (unsigned long long)c->queue_bytes / 1024);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    unsigned int seed = (unsigned int)time(NULL);
+    for (int dir = UP; dir <= DOWN; dir++) {
+        links[dir].cfg.queue_bytes = (uint64_t)IMPAIR_QUEUE_KB * 1024;
+    }
+    for (int i = 4; i < argc; i++) {
+        char name[32];
+        const char *eq = strchr(argv[i], '=');
+        if (strncmp(argv[i], "--", 2) != 0 || !eq || eq - argv[i] - 2 >= (long)sizeof(name)) {
+            fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+        snprintf(name, sizeof(name), "%.*s", (int)(eq - argv[i] - 2), argv[i] + 2);
+        const char *value = eq + 1;
+
+        if (strcmp(name, "seed") == 0) {
+            seed = (unsigned int)strtoul(value, NULL, 10);
+            continue;
+        }
+        int first = UP, last = DOWN;
+        const char *option = name;
+        if (strncmp(name, "up-", 3) == 0) {
+            last = UP;
+            option = name + 3;
+        } else if (strncmp(name, "down-", 5) == 0) {
+            first = DOWN;
+            option = name + 5;
+        }
+        for (int dir = first; dir <= last; dir++) {
+            if (parse_option(&links[dir].cfg, option, value) < 0) {
+                fprintf(stderr, "Bad option '%s'\n", argv[i]);
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+    srand(seed);
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(atoi(argv[3]));
+    if (inet_pton(AF_INET, argv[2], &server_addr.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid server IP\n");
+        return 1;
+    }
+    listen_fd = open_udp_socket(atoi(argv[1]));
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+    printf("Proxy on port %s for %s:%s (seed %u)\n", argv[1], argv[2], argv[3], seed);
+    describe(UP);
+    describe(DOWN);
+    fflush(stdout);
+
+    // Sleep until a socket is readable or the next datagram is due, to
+    // the microsecond with ppoll
+    struct pollfd fds[1 + IMPAIR_MAX_FLOWS];
+    while (!stop_requested) {
+        uint64_t now_us = timer_now_us();
+        release_due(now_us);
+        expire_flows(now_us / 1000);
+
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < num_flows; i++) {
+            fds[1 + i].fd = flows[i].fd;
+            fds[1 + i].events = POLLIN;
+        }
+        struct timespec wait, *timeout = NULL;
+        if (heap_count > 0) {
+            uint64_t due = heap[0].due_us > now_us ? heap[0].due_us - now_us : 0;
+            wait.tv_sec = due / 1000000;
+            wait.tv_nsec = (due % 1000000) * 1000;
+            timeout = &wait;
+        }
+        int ready = ppoll(fds, 1 + num_flows, timeout, NULL);
+        if (ready <= 0) {
+            continue;
+        }
+
+        int polled = num_flows;
+        if (fds[0].revents & POLLIN) {
+            drain(listen_fd, UP, -1);
+        }
+        for (int i = 0; i < polled; i++) {
+            if (fds[1 + i].revents & POLLIN) {
+                drain(flows[i].fd, DOWN, i);
+            }
+        }
+    }
+
+    print_stats();
+    return 0;
+}
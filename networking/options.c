@@ -0,0 +1,34 @@
+#include <string.h>
+#include "options.h"
+
+// Append an option as kind, length, value
+int sham_opt_put(uint8_t *buf, uint32_t *len, uint32_t cap,
+                 uint8_t kind, const void *value, uint8_t value_len) {
+    if (*len + 2 + value_len > cap) {
+        return -1;
+    }
+    buf[*len] = kind;
+    buf[*len + 1] = value_len;
+    memcpy(buf + *len + 2, value, value_len);
+    *len += 2 + value_len;
+    return 0;
+}
+
+// Walk the option list looking for a kind
+bool sham_opt_get(const uint8_t *buf, uint32_t len, uint8_t kind,
+                  void *value, uint8_t value_len) {
+    uint32_t pos = 0;
+    while (pos + 2 <= len) {
+        uint8_t opt_kind = buf[pos];
+        uint8_t opt_len = buf[pos + 1];
+        if (opt_kind == SHAM_OPT_END || pos + 2 + opt_len > len) {
+            break;
+        }
+        if (opt_kind == kind && opt_len == value_len) {
+            memcpy(value, buf + pos + 2, value_len);
+            return true;
+        }
+        pos += 2 + opt_len;
+    }
+    return false;
+}
@@ -0,0 +1,50 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Handshake Options: type-length-value entries carried as the payload of
+// SYN, SYN-ACK and FIN packets. Unknown kinds are skipped, so either end can
+// add options without breaking the other.
+#define SHAM_OPT_END        0      // Terminates the list (optional)
+#define SHAM_OPT_FILE_SIZE  1      // uint64_t: bytes the sender will transfer
+#define SHAM_OPT_DIGEST     2      // uint8_t: digest_alg_t used for the transfer
+#define SHAM_OPT_DIGEST_VALUE 3    // Digest of the whole stream, in each side's FIN
+#define SHAM_OPT_ACK_DELAY  4      // uint16_t: longest the receiver holds an ACK back (ms), in the SYN-ACK
+#define SHAM_OPT_MSS        5      // uint16_t: segment size asked for in the SYN, granted in the SYN-ACK
+#define SHAM_OPT_WSCALE     6      // uint8_t: shift the sender applies to the windows it advertises
+#define SHAM_OPT_STREAM     7      // struct sham_stream_opt: the range a parallel stream carries; echoed if accepted
+#define SHAM_OPT_RESUME     8      // struct sham_resume_opt: resumable transfer; the SYN-ACK gives the offset to resume at
+#define SHAM_OPT_COMPRESS   9      // uint8_t: compress_alg_t the sender would like to use; echoed if the receiver can decode it
+#define SHAM_OPT_FEC        10     // uint8_t: FEC scheme the sender offers (FEC_XOR); echoed if the receiver will rebuild segments
+
+// Parallel Stream: one of num_streams connections that together send a
+// file, each carrying the range [offset, offset + FILE_SIZE). The receiver
+// groups streams by client address and transfer_id.
+struct sham_stream_opt {
+    uint64_t transfer_id;          // Chosen at random by the client
+    uint64_t offset;               // Where this stream's range starts in the file
+    uint64_t total_size;           // Size of the whole file
+    uint16_t index;                // Range number, in file order
+    uint16_t num_streams;
+} __attribute__((packed));
+
+// Resumable Transfer: the client names the file with an id that stays the
+// same across reconnects, and asks for offset 0. The receiver answers with
+// the offset up to which it already holds the file; the client sends from
+// there on, and FILE_SIZE remains the size of the whole file.
+struct sham_resume_opt {
+    uint64_t transfer_id;
+    uint64_t offset;
+} __attribute__((packed));
+
+// Append an option; returns -1 if it does not fit in cap bytes
+int sham_opt_put(uint8_t *buf, uint32_t *len, uint32_t cap,
+                 uint8_t kind, const void *value, uint8_t value_len);
+
+// Copy the value of the first option of a kind; false if absent or sized differently
+bool sham_opt_get(const uint8_t *buf, uint32_t len, uint8_t kind,
+                  void *value, uint8_t value_len);
+
+#endif // OPTIONS_H
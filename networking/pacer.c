@@ -0,0 +1,97 @@
+#include <string.h>
+#include <sys/socket.h>
+#include "pacer.h"
+
+static const char *pace_mode_names[] = {"off", "bucket", "fq"};
+#define PACE_NUM_MODES (int)(sizeof(pace_mode_names) / sizeof(pace_mode_names[0]))
+
+int pacer_lookup(const char *name, pace_mode_t *mode) {
+    for (int i = 0; i < PACE_NUM_MODES; i++) {
+        if (strcmp(pace_mode_names[i], name) == 0) {
+            *mode = (pace_mode_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Start unpaced with a full bucket; the rate arrives with the first RTT
+void pacer_init(struct pacer *p, pace_mode_t mode, uint32_t mss, uint64_t max_rate, uint64_t now_us) {
+    memset(p, 0, sizeof(*p));
+    p->mode = mode;
+    p->mss = mss;
+    p->max_rate = max_rate;
+    p->depth = (uint64_t)PACE_MIN_BURST_SEGS * mss;
+    p->tokens = p->depth;
+    p->last_us = now_us;
+}
+
+void pacer_set_rate(struct pacer *p, int sockfd, uint64_t rate) {
+    if (p->mode == PACE_OFF) return;
+    if (p->max_rate > 0 && (rate == 0 || rate > p->max_rate)) {
+        rate = p->max_rate;
+    }
+    p->rate = rate;
+    p->depth = rate * PACE_BURST_US / 1000000;
+    if (p->depth < (uint64_t)PACE_MIN_BURST_SEGS * p->mss) {
+        p->depth = (uint64_t)PACE_MIN_BURST_SEGS * p->mss;
+    }
+    if (p->tokens > (int64_t)p->depth) p->tokens = p->depth;
+
+#ifdef SO_MAX_PACING_RATE
+    // The fq qdisc spaces packets within each burst; elsewhere the option
+    // is accepted and ignored. The kernel takes ~0U as unlimited.
+    if (p->mode == PACE_FQ && rate > 0) {
+        uint64_t diff = rate > p->kernel_rate ? rate - p->kernel_rate : p->kernel_rate - rate;
+        if (diff > p->kernel_rate / 8) {
+            unsigned int limit = rate < 0xfffffffeu ? (unsigned int)rate : 0xfffffffeu;
+            setsockopt(sockfd, SOL_SOCKET, SO_MAX_PACING_RATE, &limit, sizeof(limit));
+            p->kernel_rate = rate;
+        }
+    }
+#endif
+}
+
+// Tokens accrue at the rate whatever the gap, so a send's debt is always
+// paid off before the bucket fills again. The time behind a partial token
+// is carried to the next refill.
+void pacer_refill(struct pacer *p, uint64_t now_us) {
+    if (now_us <= p->last_us) return;
+    if (p->rate == 0) {
+        p->last_us = now_us;
+        p->tokens = p->depth;
+        return;
+    }
+    uint64_t elapsed = now_us - p->last_us;
+    if (elapsed > 1000000) elapsed = 1000000;   // Bounds the product; the bucket is far shallower
+    uint64_t earned = p->rate * elapsed / 1000000;
+    if (earned == 0) return;
+    p->tokens += earned;
+    if (p->tokens >= (int64_t)p->depth) {
+        p->tokens = p->depth;
+        p->last_us = now_us;
+    } else {
+        p->last_us += earned * 1000000 / p->rate;
+    }
+}
+
+void pacer_consume(struct pacer *p, uint32_t len) {
+    p->tokens -= len;
+    p->burst++;
+}
+
+uint64_t pacer_delay_us(struct pacer *p, uint32_t len) {
+    p->stalls++;
+    if (p->rate == 0 || p->tokens >= (int64_t)len) return 0;
+    return ((uint64_t)((int64_t)len - p->tokens) * 1000000 + p->rate - 1) / p->rate;
+}
+
+void pacer_end_burst(struct pacer *p) {
+    if (p->burst == 0) return;
+    int bucket = 0;
+    while (bucket < PACE_HIST_BUCKETS - 1 && p->burst >= pacer_bucket_floor(bucket + 1)) {
+        bucket++;
+    }
+    p->bursts[bucket]++;
+    p->burst = 0;
+}
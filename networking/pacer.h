@@ -0,0 +1,71 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Pacer Constants
+#define PACE_BURST_US 2000         // Bucket depth, as time at the pacing rate
+#define PACE_MIN_BURST_SEGS 2      // Bucket depth floor (segments)
+#define PACE_HIST_BUCKETS 8        // Burst sizes 1, 2-3, 4-7, ..., 128+
+
+// Pacing modes
+typedef enum {
+    PACE_OFF,                      // Send whatever the windows allow at once
+    PACE_BUCKET,                   // Token bucket in user space
+    PACE_FQ                        // Token bucket, plus SO_MAX_PACING_RATE for the fq qdisc
+} pace_mode_t;
+
+// Pacer: a token bucket filled at the congestion controller's pacing rate.
+// Tokens are bytes; a segment may go once the bucket holds its length.
+// The sender's timers tick in milliseconds, so the bucket is deep enough
+// to cover a late wakeup, and segments leave in bursts of at most
+// PACE_BURST_US worth of data rather than a whole window at once.
+// Retransmissions are never held back but are charged, so the bucket can
+// go into debt.
+struct pacer {
+    pace_mode_t mode;
+    uint32_t mss;
+    uint64_t rate;                 // Bytes per second, 0 while unknown (unpaced)
+    uint64_t max_rate;             // Cap from --rate, 0 for none
+    uint64_t depth;                // Most tokens the bucket holds
+    int64_t tokens;
+    uint64_t last_us;              // Last refill
+    uint64_t kernel_rate;          // Rate last handed to the socket
+    uint32_t burst;                // Segments queued since the last flush
+    uint64_t bursts[PACE_HIST_BUCKETS];  // Flushes by segment count, log2 buckets
+    uint64_t stalls;               // Times the bucket ran dry with the window open
+};
+
+// Parse a mode name ("off", "bucket", "fq"); returns -1 if unknown
+int pacer_lookup(const char *name, pace_mode_t *mode);
+
+void pacer_init(struct pacer *p, pace_mode_t mode, uint32_t mss, uint64_t max_rate, uint64_t now_us);
+
+// Adopt a new pacing rate (bytes per second), held to max_rate; with
+// PACE_FQ the socket's limit follows it once it moves by more than an eighth
+void pacer_set_rate(struct pacer *p, int sockfd, uint64_t rate);
+
+// Add the tokens earned since the last refill
+void pacer_refill(struct pacer *p, uint64_t now_us);
+
+// Whether a segment of len bytes may be sent now
+static inline bool pacer_ready(const struct pacer *p, uint32_t len) {
+    return p->mode == PACE_OFF || p->rate == 0 || p->tokens >= (int64_t)len;
+}
+
+// Charge a segment about to be queued
+void pacer_consume(struct pacer *p, uint32_t len);
+
+// Microseconds until a segment of len bytes may be sent; counts a stall
+uint64_t pacer_delay_us(struct pacer *p, uint32_t len);
+
+// Record the burst about to be flushed
+void pacer_end_burst(struct pacer *p);
+
+// Lower bound of histogram bucket i
+static inline uint32_t pacer_bucket_floor(int i) {
+    return 1u << i;
+}
+
+#endif // PACER_H
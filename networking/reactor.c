@@ -0,0 +1,181 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include "reactor.h"
+#include "timer_wheel.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+#ifdef __linux__
+
+int reactor_init(struct reactor *r) {
+    memset(r, 0, sizeof(*r));
+    r->deadline_ms = UINT64_MAX;
+    r->timerfd = -1;
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epfd < 0) {
+        return -1;
+    }
+
+    r->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (r->timerfd < 0) {
+        close(r->epfd);
+        return -1;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = REACTOR_TIMER;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->timerfd, &ev) < 0) {
+        reactor_close(r);
+        return -1;
+    }
+    return 0;
+}
+
+void reactor_close(struct reactor *r) {
+    if (r->timerfd >= 0) close(r->timerfd);
+    if (r->epfd >= 0) close(r->epfd);
+    r->timerfd = -1;
+    r->epfd = -1;
+}
+
+int reactor_add(struct reactor *r, int fd, uint32_t source, bool edge_triggered) {
+    if (r->num_sources == REACTOR_MAX_SOURCES) {
+        errno = ENOSPC;
+        return -1;
+    }
+    if (edge_triggered && set_nonblocking(fd) < 0) {
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (edge_triggered ? EPOLLET : 0);
+    ev.data.u32 = source;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        // Regular files cannot be polled; like select(), treat them as
+        // always readable
+        if (errno != EPERM) return -1;
+        r->always_ready |= source;
+    }
+    r->fds[r->num_sources] = fd;
+    r->sources[r->num_sources++] = source;
+    return 0;
+}
+
+int reactor_set_deadline(struct reactor *r, uint64_t deadline_ms) {
+    if (deadline_ms == r->deadline_ms) {
+        return 0;
+    }
+
+    // A zero it_value disarms the timer; an absolute time already past
+    // fires it at once
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (deadline_ms != UINT64_MAX) {
+        its.it_value.tv_sec = deadline_ms / 1000;
+        its.it_value.tv_nsec = (deadline_ms % 1000) * 1000000;
+        if (deadline_ms == 0) its.it_value.tv_nsec = 1;
+    }
+    if (timerfd_settime(r->timerfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        return -1;
+    }
+    r->deadline_ms = deadline_ms;
+    return 0;
+}
+
+uint32_t reactor_wait(struct reactor *r, int timeout_ms) {
+    if (r->always_ready) {
+        timeout_ms = 0;
+    }
+
+    struct epoll_event events[REACTOR_MAX_SOURCES + 1];
+    int n = epoll_wait(r->epfd, events, REACTOR_MAX_SOURCES + 1, timeout_ms);
+    uint32_t ready = r->always_ready;
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.u32 == REACTOR_TIMER) {
+            // One-shot: drain the expiry count, the timer is now disarmed
+            uint64_t expirations;
+            if (read(r->timerfd, &expirations, sizeof(expirations)) > 0) {
+                r->deadline_ms = UINT64_MAX;
+            }
+        }
+        ready |= events[i].data.u32;
+    }
+    return ready;
+}
+
+#else
+
+// Portable fallback: poll() over the sources, with the deadline as its timeout
+
+int reactor_init(struct reactor *r) {
+    memset(r, 0, sizeof(*r));
+    r->epfd = -1;
+    r->timerfd = -1;
+    r->deadline_ms = UINT64_MAX;
+    return 0;
+}
+
+void reactor_close(struct reactor *r) {
+    r->num_sources = 0;
+}
+
+int reactor_add(struct reactor *r, int fd, uint32_t source, bool edge_triggered) {
+    if (r->num_sources == REACTOR_MAX_SOURCES) {
+        errno = ENOSPC;
+        return -1;
+    }
+    if (edge_triggered && set_nonblocking(fd) < 0) {
+        return -1;
+    }
+    r->fds[r->num_sources] = fd;
+    r->sources[r->num_sources++] = source;
+    return 0;
+}
+
+int reactor_set_deadline(struct reactor *r, uint64_t deadline_ms) {
+    r->deadline_ms = deadline_ms;
+    return 0;
+}
+
+uint32_t reactor_wait(struct reactor *r, int timeout_ms) {
+    if (r->deadline_ms != UINT64_MAX) {
+        uint64_t now = timer_now_ms();
+        int until = r->deadline_ms > now ? (int)(r->deadline_ms - now) : 0;
+        if (timeout_ms < 0 || until < timeout_ms) timeout_ms = until;
+    }
+
+    struct pollfd pfds[REACTOR_MAX_SOURCES];
+    for (int i = 0; i < r->num_sources; i++) {
+        pfds[i].fd = r->fds[i];
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+
+    uint32_t ready = 0;
+    if (poll(pfds, r->num_sources, timeout_ms) > 0) {
+        for (int i = 0; i < r->num_sources; i++) {
+            if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) ready |= r->sources[i];
+        }
+    }
+    if (r->deadline_ms != UINT64_MAX && timer_now_ms() >= r->deadline_ms) {
+        r->deadline_ms = UINT64_MAX;
+        ready |= REACTOR_TIMER;
+    }
+    return ready;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Reactor Constants
+#define REACTOR_MAX_SOURCES 8      // Descriptors one reactor watches
+#define REACTOR_TIMER (1u << 31)   // Pseudo-source reported when the deadline passes
+
+// Sources used by the client and server loops
+#define REACTOR_SOCKET 0x1         // The protocol's UDP socket
+#define REACTOR_STDIN 0x2          // Chat input
+#define REACTOR_STOP 0x4           // Shutdown requested by a signal
+
+// Reactor: the one place an event loop sleeps. Descriptors are registered
+// as sources, each identified by a single bit; a wait returns the mask of
+// sources that became ready. Protocol timers are folded in as a single
+// absolute deadline, normally the next one in the caller's timer wheel.
+//
+// On Linux this is an epoll set with a timerfd for the deadline. Sockets
+// are edge-triggered and non-blocking, so a caller must read one until it
+// reports EAGAIN before waiting again. Elsewhere it falls back to poll().
+struct reactor {
+    int epfd;                      // epoll instance, or -1 with the poll() fallback
+    int timerfd;
+    uint64_t deadline_ms;          // Deadline the timer is armed for, UINT64_MAX if none
+    int num_sources;
+    int fds[REACTOR_MAX_SOURCES];
+    uint32_t sources[REACTOR_MAX_SOURCES];
+    uint32_t always_ready;         // Sources epoll cannot watch (regular files)
+};
+
+int reactor_init(struct reactor *r);
+void reactor_close(struct reactor *r);
+
+// Watch fd for input, reporting it as source (one bit). An edge-triggered
+// source is switched to non-blocking mode.
+int reactor_add(struct reactor *r, int fd, uint32_t source, bool edge_triggered);
+
+// Arm the timer for an absolute timer_now_ms() deadline; UINT64_MAX
+// disarms it. Costs no syscall when the deadline is unchanged.
+int reactor_set_deadline(struct reactor *r, uint64_t deadline_ms);
+
+// Sleep until a source is ready, the deadline passes or timeout_ms elapses
+// (-1 waits indefinitely). Returns the mask of ready sources, with
+// REACTOR_TIMER set if the deadline passed; 0 on timeout or a signal.
+uint32_t reactor_wait(struct reactor *r, int timeout_ms);
+
+#endif // REACTOR_H
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include "reassembly.h"
+
+// Bitmap helpers (ring-indexed)
+static bool slot_present(struct reassembly *r, uint32_t ring_idx) {
+    return (r->present[ring_idx / 64] >> (ring_idx % 64)) & 1;
+}
+
+static void slot_set(struct reassembly *r, uint32_t ring_idx, bool held) {
+    if (held) {
+        r->present[ring_idx / 64] |= (uint64_t)1 << (ring_idx % 64);
+    } else {
+        r->present[ring_idx / 64] &= ~((uint64_t)1 << (ring_idx % 64));
+    }
+}
+
+static uint32_t ring_index(struct reassembly *r, uint32_t slot) {
+    return (r->head + slot) % REASM_SLOTS;
+}
+
+// Initialize an empty buffer whose window starts at base_seq
+int reasm_init(struct reassembly *r, uint32_t base_seq, uint32_t slot_size) {
+    memset(r, 0, sizeof(*r));
+    r->base_seq = base_seq;
+    r->slot_size = slot_size;
+    return 0;
+}
+
+// Release the slot storage
+void reasm_free(struct reassembly *r) {
+    free(r->data);
+    r->data = NULL;
+}
+
+// Classify a segment, copying it into its slot if it arrived ahead of a hole
+// A segment longer than a slot is refused even in order: consuming it would
+// move base_seq past more than the one slot head steps over.
+reasm_result_t reasm_insert(struct reassembly *r, uint32_t seq, const uint8_t *data, uint32_t len) {
+    if (len == 0 || len > r->slot_size) {
+        return REASM_OUT_OF_WINDOW;
+    }
+    if (seq == r->base_seq) {
+        return REASM_IN_ORDER;
+    }
+    if (seq_lt(seq, r->base_seq)) {
+        return REASM_DUPLICATE;
+    }
+
+    uint32_t offset = seq - r->base_seq;
+    uint32_t slot = offset / r->slot_size;
+    if (offset % r->slot_size != 0 || slot >= REASM_SLOTS) {
+        return REASM_OUT_OF_WINDOW;
+    }
+
+    uint32_t idx = ring_index(r, slot);
+    if (slot_present(r, idx)) {
+        return REASM_DUPLICATE;
+    }
+
+    if (!r->data) {
+        r->data = malloc((size_t)REASM_SLOTS * r->slot_size);
+        if (!r->data) {
+            return REASM_OUT_OF_WINDOW; // Left to the sender to repeat
+        }
+    }
+
+    memcpy(r->data + (size_t)idx * r->slot_size, data, len);
+    r->len[idx] = len;
+    slot_set(r, idx, true);
+    r->held_bytes += len;
+    r->held_segments++;
+    r->total_stored++;
+    return REASM_STORED;
+}
+
+// Advance base_seq past an in-order segment the caller consumed directly
+void reasm_advance(struct reassembly *r, uint32_t len) {
+    r->base_seq += len;
+    r->head = (r->head + 1) % REASM_SLOTS;
+}
+
+// Describe the held run now contiguous with base_seq
+int reasm_contiguous(struct reassembly *r, struct iovec *iov, int max_iov) {
+    int n = 0;
+    while (n < max_iov && n < REASM_SLOTS) {
+        uint32_t idx = ring_index(r, n);
+        if (!slot_present(r, idx)) break;
+
+        iov[n].iov_base = r->data + (size_t)idx * r->slot_size;
+        iov[n].iov_len = r->len[idx];
+        n++;
+
+        // A short segment ends the run: nothing can follow it contiguously
+        if (r->len[idx] < r->slot_size) break;
+    }
+    return n;
+}
+
+// Release a delivered run, moving base_seq past it
+void reasm_release(struct reassembly *r, int num_slots) {
+    for (int i = 0; i < num_slots; i++) {
+        uint32_t len = r->len[r->head];
+        slot_set(r, r->head, false);
+        r->held_bytes -= len;
+        r->held_segments--;
+        r->base_seq += len;
+        r->head = (r->head + 1) % REASM_SLOTS;
+    }
+}
+
+// Fill SACK blocks for held ranges, the one containing recent_seq first
+int reasm_sack_blocks(struct reassembly *r, struct sham_sack_block *blocks,
+                      int max_blocks, uint32_t recent_seq) {
+    struct sham_sack_block ranges[SHAM_MAX_SACK_BLOCKS * 4];
+    int max_ranges = sizeof(ranges) / sizeof(ranges[0]);
+    int num_ranges = 0;
+    int recent = -1;
+
+    if (r->held_segments == 0 || max_blocks <= 0) {
+        return 0;
+    }
+
+    // Collect held runs in ascending order
+    for (uint32_t slot = 0; slot < REASM_SLOTS && num_ranges < max_ranges; slot++) {
+        uint32_t idx = ring_index(r, slot);
+        if (!slot_present(r, idx)) continue;
+
+        uint32_t start = r->base_seq + slot * r->slot_size;
+        uint32_t end = start + r->len[idx];
+        if (num_ranges > 0 && ranges[num_ranges - 1].end_seq == start) {
+            ranges[num_ranges - 1].end_seq = end;
+        } else {
+            ranges[num_ranges].start_seq = start;
+            ranges[num_ranges].end_seq = end;
+            num_ranges++;
+        }
+        if (seq_leq(start, recent_seq) && seq_lt(recent_seq, end)) {
+            recent = num_ranges - 1;
+        }
+    }
+
+    int num_blocks = 0;
+    if (recent >= 0) {
+        blocks[num_blocks++] = ranges[recent];
+    }
+    for (int i = 0; i < num_ranges && num_blocks < max_blocks; i++) {
+        if (i != recent) {
+            blocks[num_blocks++] = ranges[i];
+        }
+    }
+    return num_blocks;
+}
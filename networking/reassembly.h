@@ -0,0 +1,55 @@
+#ifndef REASSEMBLY_H
+#define REASSEMBLY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+#include "sham.h"
+
+// Reassembly Constants
+#define REASM_SLOTS SHAM_MAX_WINDOW   // Segments held above the next expected one
+
+// Result of inserting a segment
+typedef enum {
+    REASM_IN_ORDER,                // Segment starts at base_seq; consume it directly
+    REASM_STORED,                  // Held until the hole below it fills
+    REASM_DUPLICATE,               // Already delivered or already held
+    REASM_OUT_OF_WINDOW            // Beyond the buffer or not slot-aligned; dropped
+} reasm_result_t;
+
+// Reassembly Buffer: a ring of fixed-size slots covering the receive window
+// [base_seq, base_seq + REASM_SLOTS * slot_size). A bitmap tracks which
+// slots hold data, so lookup, insert and SACK generation never allocate.
+// The slot storage itself is allocated by the first out-of-order segment;
+// a connection that never sees reordering never pays for it.
+struct reassembly {
+    uint32_t base_seq;                   // Next expected sequence number (slot 0); may wrap
+    uint32_t slot_size;                  // Segment size; segments are aligned to it
+    uint32_t head;                       // Ring index of the slot for base_seq
+    uint64_t present[REASM_SLOTS / 64];  // Bitmap of held slots, ring-indexed
+    uint32_t len[REASM_SLOTS];           // Payload length of each held slot
+    uint8_t *data;                       // REASM_SLOTS * slot_size bytes, or NULL
+    uint32_t held_bytes;                 // Bytes currently held out of order
+    uint32_t held_segments;              // Segments currently held out of order
+    uint64_t total_stored;               // Segments ever stored out of order
+};
+
+int reasm_init(struct reassembly *r, uint32_t base_seq, uint32_t slot_size);
+void reasm_free(struct reassembly *r);
+
+// Classify a segment, copying it into its slot if it arrived ahead of a hole
+reasm_result_t reasm_insert(struct reassembly *r, uint32_t seq, const uint8_t *data, uint32_t len);
+
+// Advance base_seq past an in-order segment the caller consumed directly
+void reasm_advance(struct reassembly *r, uint32_t len);
+
+// Describe the held run now contiguous with base_seq, up to max_iov slots.
+// The caller consumes it in one go, then releases it with reasm_release().
+int reasm_contiguous(struct reassembly *r, struct iovec *iov, int max_iov);
+void reasm_release(struct reassembly *r, int num_slots);
+
+// Fill SACK blocks for held ranges, the one containing recent_seq first
+int reasm_sack_blocks(struct reassembly *r, struct sham_sack_block *blocks,
+                      int max_blocks, uint32_t recent_seq);
+
+#endif // REASSEMBLY_H
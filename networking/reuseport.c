@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "reuseport.h"
+
+#ifdef __linux__
+#include <linux/filter.h>
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#endif
+
+int reuseport_open(int port, int rcvbuf) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int one = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("SO_REUSEPORT");
+        close(sockfd);
+        return -1;
+    }
+    if (rcvbuf > 0) {
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+#ifdef __linux__
+
+// The program runs with the packet positioned at the UDP payload, so the
+// IP and UDP headers are reached through the SKF_NET_OFF window. The
+// value it returns is the index of the socket in the group.
+int reuseport_attach_steering(int sockfd, steer_mode_t mode, int num_workers) {
+    struct sock_filter hash_prog[] = {
+        // A = source address, kept in M[0]
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+        BPF_STMT(BPF_ST, 0),
+        // X = IP header length, then A = source and destination ports
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, SKF_NET_OFF + 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_IND, SKF_NET_OFF + 0),
+        // Mix: (ports ^ address) * golden ratio, high bits, modulo workers
+        BPF_STMT(BPF_LDX | BPF_MEM, 0),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1u),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)num_workers),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_filter cpu_prog[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)num_workers),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+
+    struct sock_fprog prog;
+    if (mode == STEER_HASH) {
+        prog.len = sizeof(hash_prog) / sizeof(hash_prog[0]);
+        prog.filter = hash_prog;
+    } else if (mode == STEER_CPU) {
+        prog.len = sizeof(cpu_prog) / sizeof(cpu_prog[0]);
+        prog.filter = cpu_prog;
+    } else {
+        return 0;
+    }
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        perror("SO_ATTACH_REUSEPORT_CBPF");
+        return -1;
+    }
+    return 0;
+}
+
+#else
+
+// Steering programs are Linux only
+int reuseport_attach_steering(int sockfd, steer_mode_t mode, int num_workers) {
+    if (mode == STEER_KERNEL) return 0;
+    fprintf(stderr, "Reuseport steering programs are not supported on this system\n");
+    return -1;
+}
+
+#endif
+
+bool steer_lookup(const char *name, steer_mode_t *mode) {
+    if (strcmp(name, "kernel") == 0) {
+        *mode = STEER_KERNEL;
+    } else if (strcmp(name, "hash") == 0) {
+        *mode = STEER_HASH;
+    } else if (strcmp(name, "cpu") == 0) {
+        *mode = STEER_CPU;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#ifdef __linux__
+
+int pin_current_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        fprintf(stderr, "Failed to pin to CPU %d: %s\n", cpu, strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+#else
+
+int pin_current_thread(int cpu) {
+    fprintf(stderr, "CPU pinning is not supported on this system\n");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef REUSEPORT_H
+#define REUSEPORT_H
+
+#include <stdbool.h>
+
+// Worker Steering: how the kernel spreads datagrams over the sockets of a
+// SO_REUSEPORT group. Every datagram of a flow must reach the same worker,
+// since that worker holds the connection.
+typedef enum {
+    STEER_KERNEL,                  // Kernel's own 4-tuple hash
+    STEER_HASH,                    // CBPF: our 4-tuple hash, modulo the worker count
+    STEER_CPU                      // CBPF: the CPU that received the datagram
+} steer_mode_t;
+
+// Open a UDP socket bound to port with SO_REUSEPORT set, so one socket per
+// worker can share the port. Returns the socket or -1.
+int reuseport_open(int port, int rcvbuf);
+
+// Attach a classic BPF program to the group so that socket i (in bind
+// order) receives the datagrams selected for worker i. Returns 0 or -1;
+// on failure the kernel's default hashing stays in effect.
+int reuseport_attach_steering(int sockfd, steer_mode_t mode, int num_workers);
+
+// Look up a steering mode by name ("kernel", "hash", "cpu"); false if unknown
+bool steer_lookup(const char *name, steer_mode_t *mode);
+
+// Pin the calling thread to one CPU. Returns 0 or -1.
+int pin_current_thread(int cpu);
+
+#endif // REUSEPORT_H
@@ -0,0 +1,58 @@
+#include <stddef.h>
+#include "rtt.h"
+
+// Clamp an RTO to the configured bounds
+static uint32_t clamp_rto(uint64_t rto_ms) {
+    if (rto_ms < SHAM_MIN_RTO_MS) return SHAM_MIN_RTO_MS;
+    if (rto_ms > SHAM_MAX_RTO_MS) return SHAM_MAX_RTO_MS;
+    return (uint32_t)rto_ms;
+}
+
+// Start with no samples and the protocol's default timeout
+void rtt_init(struct rtt_estimator *e, uint32_t initial_rto_ms) {
+    e->srtt_us = 0;
+    e->rttvar_us = 0;
+    e->rto_ms = clamp_rto(initial_rto_ms);
+    e->ack_delay_ms = 0;
+    e->samples = 0;
+    e->backoff = 0;
+}
+
+// Update SRTT/RTTVAR with alpha = 1/8, beta = 1/4 and recompute the RTO
+void rtt_sample(struct rtt_estimator *e, uint32_t sample_us) {
+    if (e->samples == 0) {
+        e->srtt_us = sample_us;
+        e->rttvar_us = sample_us / 2;
+    } else {
+        uint32_t delta = sample_us > e->srtt_us ? sample_us - e->srtt_us : e->srtt_us - sample_us;
+        e->rttvar_us = (3 * (uint64_t)e->rttvar_us + delta) / 4;
+        e->srtt_us = (7 * (uint64_t)e->srtt_us + sample_us) / 8;
+    }
+    e->samples++;
+    e->backoff = 0;
+
+    // RTO = SRTT + max(G, 4 * RTTVAR), rounded up to whole milliseconds. On
+    // a steady path RTTVAR decays towards zero, and G keeps ordinary jitter
+    // from firing the timer. A delayed ACK can come late by the receiver's
+    // ACK delay on top of that.
+    uint64_t var_us = 4 * (uint64_t)e->rttvar_us;
+    if (var_us < SHAM_RTO_GRANULARITY_MS * 1000) var_us = SHAM_RTO_GRANULARITY_MS * 1000;
+    uint64_t rto_us = (uint64_t)e->srtt_us + var_us + (uint64_t)e->ack_delay_ms * 1000;
+    e->rto_ms = clamp_rto((rto_us + 999) / 1000);
+}
+
+// Double the RTO after a retransmission timeout; it stays backed off until
+// a segment that was sent only once is acknowledged
+void rtt_backoff(struct rtt_estimator *e) {
+    e->backoff++;
+    e->rto_ms = clamp_rto((uint64_t)e->rto_ms * 2);
+}
+
+// Microseconds elapsed since a timestamp
+uint32_t elapsed_us(const struct timeval *since) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    int64_t us = (int64_t)(now.tv_sec - since->tv_sec) * 1000000 + (now.tv_usec - since->tv_usec);
+    return us < 0 ? 0 : (uint32_t)us;
+}
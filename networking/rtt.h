@@ -0,0 +1,35 @@
+#ifndef RTT_H
+#define RTT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+// RTO Bounds
+#define SHAM_MIN_RTO_MS 200        // Floor for the adaptive timeout
+#define SHAM_RTO_GRANULARITY_MS 10 // G in RFC 6298: least margin kept above SRTT
+#define SHAM_MAX_RTO_MS 60000      // Ceiling after exponential backoff
+
+// RTT Estimator: smoothed RTT and RTT variance (RFC 6298). Times are kept
+// in microseconds so loopback and LAN round trips are not rounded to zero.
+struct rtt_estimator {
+    uint32_t srtt_us;              // Smoothed round-trip time
+    uint32_t rttvar_us;            // Round-trip time variation
+    uint32_t rto_ms;               // Current retransmission timeout
+    uint32_t ack_delay_ms;         // Longest the receiver may hold an ACK back
+    uint32_t samples;              // Valid samples taken so far
+    int backoff;                   // Timeouts since the last valid sample
+};
+
+void rtt_init(struct rtt_estimator *e, uint32_t initial_rto_ms);
+
+// Feed a sample from a segment that was never retransmitted (Karn's rule)
+void rtt_sample(struct rtt_estimator *e, uint32_t sample_us);
+
+// Double the RTO after a retransmission timeout
+void rtt_backoff(struct rtt_estimator *e);
+
+// Microseconds elapsed since a timestamp
+uint32_t elapsed_us(const struct timeval *since);
+
+#endif // RTT_H
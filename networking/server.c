@@ -6,12 +6,23 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
-#include <sys/select.h>
 #include <errno.h>
 #include <time.h>
 #include <stdarg.h>
-#include <openssl/md5.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/resource.h>
 #include "sham.h"
+#include "reassembly.h"
+#include "batch_io.h"
+#include "options.h"
+#include "writer.h"
+#include "digest.h"
+#include "connection.h"
+#include "reuseport.h"
+#include "reactor.h"
+#include "transfer.h"
+#include "checkpoint.h"
 
 // Global variables
 static FILE *log_file = NULL;
@@ -19,11 +30,77 @@ static bool logging_enabled = false;
 static double loss_rate = 0.0;
 static bool chat_mode = false;
 
-// Buffer for received data
-static uint8_t recv_buffer[10 * 1024 * 1024]; // 10MB buffer
-static uint32_t recv_buffer_size = 0;
-static uint32_t next_expected_seq = 0;
-static uint16_t receiver_window = 65535; // Initial window size
+static bool multi_mode = false;
+static volatile sig_atomic_t stop_requested = 0;
+static int stop_pipe[2] = {-1, -1};      // Written on stop to wake every worker
+
+static uint32_t max_connections = 1;     // Per worker; one unless --multi
+static uint32_t ack_every = ACK_EVERY_DEFAULT;
+static uint32_t ack_delay_ms = ACK_DELAY_DEFAULT_MS;
+static bool offload = true;              // UDP GSO/GRO where the kernel has them
+static struct connection *chat_connection = NULL;
+
+// Server Worker: one receive loop with its own socket, connection table,
+// batches and counters. Workers share nothing on the data path; a client
+// stays with the worker whose socket the kernel steers its flow to.
+struct worker {
+    int index;
+    int sockfd;
+    int cpu;                       // CPU to pin to, or -1
+    pthread_t thread;
+    
+    struct conn_table connections; // Connections by peer address
+    struct timer_wheel timers;     // Connection deadlines
+    uint64_t now_ms;               // Clock read once per received batch
+    struct reactor reactor;        // Socket, stop pipe and next deadline
+    uint32_t window_limit;         // Largest window the socket buffer can absorb
+    unsigned int rand_seed;        // Simulated loss draws; rand() would be shared between workers
+    uint32_t completed_connections;
+    uint32_t closed_connections;
+    
+    // Delayed ACK accounting
+    uint64_t data_segments;        // Data segments received
+    uint64_t data_acks;            // ACKs sent for them
+    uint64_t timer_acks;           // ...of which the delay timer sent
+    uint64_t checksum_errors;      // Corrupted datagrams dropped
+    
+    // Batched datagram I/O, shared by the worker's connections; replies
+    // are built in place until the batch is flushed
+    struct io_stats io_stats;
+    struct send_batch tx_batch;
+    struct recv_batch rx_batch;
+    struct sham_packet ack_buffers[IO_BATCH_MAX];
+    uint8_t inflate_buffer[SHAM_MAX_DATA_SIZE];   // A compressed segment, decoded
+    struct sham_packet rebuild_buffer;             // A segment rebuilt from parity
+};
+
+static struct worker *workers = NULL;
+static int num_workers = 1;
+static steer_mode_t steer_mode = STEER_KERNEL;
+static bool pin_workers = false;
+
+// Ask every event loop to finish; safe to call from a signal handler
+void request_stop(void) {
+    stop_requested = 1;
+    if (stop_pipe[1] >= 0) {
+        ssize_t ignored = write(stop_pipe[1], "", 1);
+        (void)ignored;
+    }
+}
+
+void handle_stop_signal(int sig) {
+    request_stop();
+}
+
+// Each concurrent transfer holds an open output file, so lift the
+// descriptor limit as far as the hard limit allows
+void raise_file_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
 
 // Initialize logging
 void init_logging(const char *log_filename) {
@@ -57,7 +134,8 @@ void log_event(const char *format, ...) {
     gettimeofday(&tv, NULL);
     curtime = tv.tv_sec;
     
-    strftime(time_buffer, 30, "%Y-%m-%d %H:%M:%S", localtime(&curtime));
+    struct tm tm_buf;
+    strftime(time_buffer, 30, "%Y-%m-%d %H:%M:%S", localtime_r(&curtime, &tm_buf));
     fprintf(log_file, "[%s.%06ld] [LOG] ", time_buffer, tv.tv_usec);
     
     va_list args;
@@ -70,17 +148,21 @@ void log_event(const char *format, ...) {
 }
 
 // Simulate packet loss
-bool should_drop_packet(void) {
+bool should_drop_packet(struct worker *w) {
     if (loss_rate <= 0.0) return false;
-    double rand_val = (double)rand() / RAND_MAX;
+    double rand_val = (double)rand_r(&w->rand_seed) / RAND_MAX;
     return rand_val < loss_rate;
 }
 
 // Send packet
 int send_packet(int sockfd, struct sockaddr_in *dest_addr, struct sham_packet *pkt, uint32_t data_len) {
     size_t total_len = SHAM_HEADER_SIZE + data_len;
+    sham_checksum_set(&pkt->header, pkt->data, data_len);
     ssize_t sent = sendto(sockfd, pkt, total_len, 0, 
                           (struct sockaddr*)dest_addr, sizeof(*dest_addr));
+    if (sent < 0 && (errno == EAGAIN || errno == ENOBUFS)) {
+        return 0; // Socket buffer full: treated as lost
+    }
     if (sent < 0) {
         perror("sendto failed");
         return -1;
@@ -88,223 +170,1004 @@ int send_packet(int sockfd, struct sockaddr_in *dest_addr, struct sham_packet *p
     return 0;
 }
 
-// Receive packet
-int recv_packet(int sockfd, struct sham_packet *pkt, struct sockaddr_in *src_addr, uint32_t *data_len) {
-    socklen_t addr_len = sizeof(*src_addr);
-    ssize_t recv_len = recvfrom(sockfd, pkt, SHAM_PACKET_SIZE, 0,
-                                (struct sockaddr*)src_addr, &addr_len);
-    if (recv_len < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return 0; // Timeout
-        }
-        perror("recvfrom failed");
-        return -1;
+// Print a line about a connection. With several clients each line is
+// prefixed with the connection id and peer so the output can be told apart.
+void conn_printf(struct connection *c, const char *format, ...) {
+    // Hold stdout so lines from different workers do not interleave
+    flockfile(stdout);
+    if (multi_mode || c->transfer) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &c->addr.sin_addr, ip, sizeof(ip));
+        printf("[%u %s:%u] ", c->id, ip, ntohs(c->addr.sin_port));
     }
     
-    if (recv_len < (ssize_t)SHAM_HEADER_SIZE) {
-        return -1; // Invalid packet
-    }
-    
-    *data_len = recv_len - SHAM_HEADER_SIZE;
-    return 1;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    funlockfile(stdout);
 }
 
-// Handle 3-way handshake (server side)
-int handle_handshake(int sockfd, struct sockaddr_in *client_addr) {
-    struct sham_packet pkt;
-    uint32_t data_len;
+// Receive buffer: bounded by the reassembly ring, which must hold anything
+// the sender may put in flight, and by the socket buffer, which must absorb
+// a whole window arriving at once
+uint32_t receive_buffer(struct worker *w, struct connection *c) {
+    uint32_t buffer = REASM_SLOTS * c->mss;
+    uint32_t max_window = 65535u << c->wscale;
     
-    // Wait for SYN (retry on timeout)
-    log_event("Waiting for SYN...");
-    int ret;
-    while ((ret = recv_packet(sockfd, &pkt, client_addr, &data_len)) == 0) {
-        // Keep waiting on timeout
-        continue;
+    if (buffer > w->window_limit) buffer = w->window_limit;
+    if (buffer > max_window) buffer = max_window;
+    return buffer;
+}
+
+// Advertised window: the receive buffer less what is waiting in it, the
+// slots held out of order and the in-order bytes not yet written to the
+// file. A writer that has failed takes nothing more, so the window closes
+// and the sender's zero-window probes find it still closed.
+uint32_t compute_receiver_window(struct worker *w, struct connection *c) {
+    if (c->writer.error) {
+        return 0;
     }
-    if (ret < 0) {
-        return -1;
+    uint32_t buffer = receive_buffer(w, c);
+    uint64_t used = (uint64_t)c->reasm.held_segments * c->mss + (c->writer.committed - c->writer.flushed);
+    return used < buffer ? buffer - (uint32_t)used : 0;
+}
+
+// Smallest shift that lets the 16-bit header field express the whole window
+uint8_t choose_wscale(uint32_t window) {
+    uint8_t shift = 0;
+    while (shift < SHAM_MAX_WSCALE && (window >> shift) > 65535) {
+        shift++;
+    }
+    return shift;
+}
+
+// The window as the header carries it. SYN-ACKs are never scaled, since
+// the scale only takes effect once both ends have seen the options.
+uint16_t advertised_window(const struct connection *c, uint16_t flags) {
+    if (flags & SHAM_SYN) {
+        return c->receiver_window > 65535 ? 65535 : c->receiver_window;
     }
+    return c->receiver_window >> c->wscale;
+}
+
+// Queue a control packet (SYN-ACK, ACK or FIN) on the send batch, with
+// handshake options if opt_len is non-zero
+void queue_control(struct worker *w, struct connection *c, uint32_t seq, uint32_t ack, uint16_t flags,
+                   const uint8_t *opts, uint32_t opt_len) {
+    if (w->tx_batch.count == IO_BATCH_MAX) {
+        send_batch_flush(&w->tx_batch);
+    }
+    struct sham_packet *pkt = &w->ack_buffers[w->tx_batch.count];
     
-    if (!(pkt.header.flags & SHAM_SYN)) {
-        fprintf(stderr, "Expected SYN packet\n");
-        return -1;
+    memset(&pkt->header, 0, sizeof(pkt->header));
+    pkt->header.seq_num = seq;
+    pkt->header.ack_num = ack;
+    pkt->header.flags = flags;
+    pkt->header.window_size = advertised_window(c, flags);
+    if (opt_len > 0) {
+        memcpy(pkt->data, opts, opt_len);
+    }
+    sham_checksum_set(&pkt->header, pkt->data, opt_len);
+    send_batch_add(&w->tx_batch, &c->addr, pkt, SHAM_HEADER_SIZE + opt_len, NULL, 0);
+}
+
+// Path MTU probe: echo the size that arrived, so the client learns the
+// largest datagram the path carries. It is answered without connection
+// state and with a bare header, so a probe can never be amplified.
+void answer_pmtu_probe(struct worker *w, struct sockaddr_in *src, uint32_t data_len) {
+    if (w->tx_batch.count == IO_BATCH_MAX) {
+        send_batch_flush(&w->tx_batch);
     }
+    struct sham_packet *pkt = &w->ack_buffers[w->tx_batch.count];
     
-    uint32_t client_seq = pkt.header.seq_num;
+    log_event("RCV PMTU PROBE LEN=%u", data_len);
+    memset(&pkt->header, 0, sizeof(pkt->header));
+    pkt->header.ack_num = data_len;
+    pkt->header.flags = SHAM_PMTU | SHAM_ACK;
+    sham_checksum_set(&pkt->header, pkt->data, 0);
+    send_batch_add(&w->tx_batch, src, pkt, SHAM_HEADER_SIZE, NULL, 0);
+}
+
+// Name the output file. Concurrent clients each get their own; a
+// resumable transfer is named by its id so a reconnect finds it again.
+void name_output_file(struct connection *c) {
+    if (multi_mode && c->resumable) {
+        snprintf(c->output_filename, sizeof(c->output_filename), "received_file.%016llx",
+                 (unsigned long long)c->resume_id);
+    } else if (multi_mode) {
+        snprintf(c->output_filename, sizeof(c->output_filename), "received_file.%u", c->id);
+    } else {
+        snprintf(c->output_filename, sizeof(c->output_filename), "received_file");
+    }
+}
+
+// Pick up a resumable transfer from its checkpoint, if there is one for
+// this file; the stream then starts at the checkpointed offset
+void load_checkpoint(struct connection *c) {
+    struct checkpoint ckpt;
+    name_output_file(c);
+    if (!checkpoint_load(c->output_filename, c->resume_id, c->expected_file_size, c->digest_alg, &ckpt)) {
+        return;
+    }
+    c->resume_offset = ckpt.committed;
+    c->rx_digest = ckpt.digest;
+    log_event("RESUME OFFSET=%llu", (unsigned long long)c->resume_offset);
+}
+
+// Record the progress of a resumable transfer: everything committed so
+// far is flushed, and the checkpoint replaced once it is on disk
+void save_checkpoint(struct connection *c) {
+    uint64_t committed = c->writer.committed;
+    if (writer_flush(&c->writer) < 0 ||
+        checkpoint_save(c->output_filename, c->writer.fd, c->resume_id, c->expected_file_size,
+                        c->writer.base_offset + committed, &c->rx_digest) < 0) {
+        return;
+    }
+    c->checkpointed = committed;
+    log_event("CHECKPOINT OFFSET=%llu", (unsigned long long)(c->writer.base_offset + committed));
+}
+
+// SYN: record the client's options and answer with a SYN-ACK. A repeated
+// SYN means our SYN-ACK was lost, so it is simply answered again. The
+// segment size asked for is granted up to SHAM_MAX_DATA_SIZE and echoed;
+// both ends then cut and reassemble the stream at exactly that size. A
+// client that offers window scaling gets our shift back, sized so the
+// whole reassembly ring can be advertised. A stream of a parallel transfer
+// joins it, and the echoed STREAM option tells the client it was accepted.
+// A resumable transfer is told the offset its checkpoint reached, if any.
+// A compression algorithm we can decode is echoed to accept it, and so is
+// FEC, which caps the segment size so parity still fits in a packet.
+void handle_syn(struct worker *w, struct connection *c, struct sham_packet *pkt, uint32_t data_len) {
+    uint32_t client_seq = pkt->header.seq_num;
     log_event("RCV SYN SEQ=%u", client_seq);
     
+    if (c->state == STATE_CLOSED) {
+        if (sham_opt_get(pkt->data, data_len, SHAM_OPT_FILE_SIZE,
+                         &c->expected_file_size, sizeof(c->expected_file_size))) {
+            log_event("RCV OPT FILE_SIZE=%llu", (unsigned long long)c->expected_file_size);
+        }
+        uint8_t alg;
+        if (sham_opt_get(pkt->data, data_len, SHAM_OPT_DIGEST, &alg, sizeof(alg)) && digest_name(alg)) {
+            c->digest_alg = alg;
+            log_event("RCV OPT DIGEST=%s", digest_name(c->digest_alg));
+        }
+        uint16_t mss;
+        c->mss = SHAM_DATA_SIZE;
+        if (sham_opt_get(pkt->data, data_len, SHAM_OPT_MSS, &mss, sizeof(mss)) && mss > 0) {
+            c->mss = mss < SHAM_MAX_DATA_SIZE ? mss : SHAM_MAX_DATA_SIZE;
+            log_event("RCV OPT MSS=%u", mss);
+        }
+        uint8_t fec;
+        c->fec = 0;
+        if (!chat_mode && sham_opt_get(pkt->data, data_len, SHAM_OPT_FEC, &fec, sizeof(fec)) && fec == FEC_XOR) {
+            c->fec = fec;
+            if (c->mss > SHAM_FEC_MAX_MSS) c->mss = SHAM_FEC_MAX_MSS;
+            log_event("RCV OPT FEC=%u", fec);
+        }
+        uint8_t peer_wscale;
+        c->wscale = 0;
+        if (sham_opt_get(pkt->data, data_len, SHAM_OPT_WSCALE, &peer_wscale, sizeof(peer_wscale))) {
+            uint32_t largest = REASM_SLOTS * c->mss;
+            c->wscale = choose_wscale(largest < w->window_limit ? largest : w->window_limit);
+            log_event("RCV OPT WSCALE=%u", peer_wscale);
+        }
+        struct sham_stream_opt stream;
+        if (!chat_mode && sham_opt_get(pkt->data, data_len, SHAM_OPT_STREAM, &stream, sizeof(stream))) {
+            c->transfer = transfer_join(c->addr.sin_addr.s_addr, &stream, c->expected_file_size, c->digest_alg);
+            if (c->transfer) {
+                c->stream = stream;
+            }
+            log_event("RCV OPT STREAM=%u/%u OFFSET=%llu%s", stream.index, stream.num_streams,
+                      (unsigned long long)stream.offset, c->transfer ? "" : " REJECTED");
+        }
+        struct sham_resume_opt resume;
+        if (!chat_mode && !c->transfer && c->expected_file_size > 0 &&
+            sham_opt_get(pkt->data, data_len, SHAM_OPT_RESUME, &resume, sizeof(resume))) {
+            c->resumable = true;
+            c->resume_id = resume.transfer_id;
+            log_event("RCV OPT RESUME ID=%016llx", (unsigned long long)c->resume_id);
+            load_checkpoint(c);
+        }
+        uint8_t compress_alg;
+        c->compress_alg = COMPRESS_NONE;
+        if (!chat_mode && sham_opt_get(pkt->data, data_len, SHAM_OPT_COMPRESS, &compress_alg, sizeof(compress_alg)) &&
+            compress_name(compress_alg)) {
+            c->compress_alg = compress_alg;
+            log_event("RCV OPT COMPRESS=%s", compress_name(c->compress_alg));
+        }
+        
+        c->next_expected_seq = client_seq + 1;
+        c->data_start_seq = client_seq + 1;
+        c->state = STATE_SYN_RECEIVED;
+    }
+    
     // Send SYN-ACK
     uint32_t server_seq = 5000; // Initial server sequence number
-    memset(&pkt, 0, sizeof(pkt));
-    pkt.header.seq_num = server_seq;
-    pkt.header.ack_num = client_seq + 1;
-    pkt.header.flags = SHAM_SYN | SHAM_ACK;
-    pkt.header.window_size = receiver_window;
+    uint8_t opts[128];
+    uint32_t opt_len = 0;
+    uint16_t mss = c->mss;
+    sham_opt_put(opts, &opt_len, sizeof(opts), SHAM_OPT_MSS, &mss, sizeof(mss));
+    if (c->wscale > 0) {
+        sham_opt_put(opts, &opt_len, sizeof(opts), SHAM_OPT_WSCALE, &c->wscale, sizeof(c->wscale));
+    }
+    if (c->transfer) {
+        sham_opt_put(opts, &opt_len, sizeof(opts), SHAM_OPT_STREAM, &c->stream, sizeof(c->stream));
+    }
+    if (c->resumable) {
+        struct sham_resume_opt resume = { c->resume_id, c->resume_offset };
+        sham_opt_put(opts, &opt_len, sizeof(opts), SHAM_OPT_RESUME, &resume, sizeof(resume));
+    }
+    if (c->compress_alg != COMPRESS_NONE) {
+        uint8_t compress_alg = c->compress_alg;
+        sham_opt_put(opts, &opt_len, sizeof(opts), SHAM_OPT_COMPRESS, &compress_alg, sizeof(compress_alg));
+    }
+    if (c->fec) {
+        sham_opt_put(opts, &opt_len, sizeof(opts), SHAM_OPT_FEC, &c->fec, sizeof(c->fec));
+    }
+    if (ack_delay_ms > 0) {
+        uint16_t ack_delay = ack_delay_ms > 65535 ? 65535 : (uint16_t)ack_delay_ms;
+        sham_opt_put(opts, &opt_len, sizeof(opts), SHAM_OPT_ACK_DELAY, &ack_delay, sizeof(ack_delay));
+    }
     
-    log_event("SND SYN-ACK SEQ=%u ACK=%u", server_seq, pkt.header.ack_num);
-    send_packet(sockfd, client_addr, &pkt, 0);
+    c->receiver_window = compute_receiver_window(w, c);
+    log_event("SND SYN-ACK SEQ=%u ACK=%u MSS=%u WSCALE=%u", server_seq, client_seq + 1, c->mss, c->wscale);
+    queue_control(w, c, server_seq, client_seq + 1, SHAM_SYN | SHAM_ACK, opts, opt_len);
+}
+
+// The handshake is complete: set up the receive path
+int conn_establish(struct connection *c) {
+    log_event("RCV ACK FOR SYN");
+    reasm_init(&c->reasm, c->next_expected_seq, c->mss);
+    c->state = STATE_ESTABLISHED;
     
-    // Wait for ACK (retry on timeout)
-    while ((ret = recv_packet(sockfd, &pkt, client_addr, &data_len)) == 0) {
-        // Keep waiting on timeout
-        continue;
+    if (chat_mode) {
+        conn_printf(c, "Connection established\n");
+        chat_connection = c;
+        return 0;
     }
-    if (ret < 0) {
-        return -1;
+    
+    name_output_file(c);
+    if (c->transfer) {
+        // Streams of a parallel transfer share the file the first one
+        // named, each writing from the start of its range
+        int fd = transfer_open(c->transfer, c->output_filename);
+        if (fd < 0 || writer_attach(&c->writer, fd, c->stream.offset) < 0) {
+            return -1;
+        }
+        snprintf(c->output_filename, sizeof(c->output_filename), "%s", c->transfer->filename);
+        conn_printf(c, "Connection established, writing bytes %llu-%llu of %s (stream %u of %u)\n",
+                    (unsigned long long)c->stream.offset,
+                    (unsigned long long)(c->stream.offset + c->expected_file_size),
+                    c->output_filename, c->stream.index + 1, c->stream.num_streams);
+    } else {
+        if (multi_mode) {
+            conn_printf(c, "Connection established, writing %s\n", c->output_filename);
+        } else {
+            conn_printf(c, "Connection established\n");
+        }
+        if (c->resume_offset > 0) {
+            conn_printf(c, "Resuming at byte %llu of %llu\n", (unsigned long long)c->resume_offset,
+                        (unsigned long long)c->expected_file_size);
+        }
+        if (writer_open(&c->writer, c->output_filename, c->expected_file_size, c->resume_offset) < 0) {
+            return -1;
+        }
     }
     
-    if (!(pkt.header.flags & SHAM_ACK)) {
-        fprintf(stderr, "Expected ACK packet\n");
+    // A resumed digest carries on from the checkpoint
+    if (c->resume_offset == 0) {
+        digest_init(&c->rx_digest, c->digest_alg);
+    }
+    if (c->fec && fec_decoder_init(&c->fec_rx, c->data_start_seq, c->mss) < 0) {
+        perror("Failed to allocate FEC buffers");
         return -1;
     }
+    return 0;
+}
+
+// Send a cumulative ACK, with SACK blocks when data is held out of order.
+// The block containing recent_seq goes first so the sender learns about
+// the newest arrivals even when there are more ranges than blocks.
+void send_ack(struct worker *w, struct connection *c, uint32_t recent_seq) {
+    if (w->tx_batch.count == IO_BATCH_MAX) {
+        send_batch_flush(&w->tx_batch);
+    }
+    struct sham_packet *ack_pkt = &w->ack_buffers[w->tx_batch.count];
+    uint32_t previous_window = c->receiver_window;
+    c->receiver_window = compute_receiver_window(w, c);
+    if (c->receiver_window < c->mss && previous_window >= c->mss) {
+        log_event("FLOW WIN CLOSED");
+    }
     
-    log_event("RCV ACK FOR SYN");
+    // Whatever was waiting on the delayed ACK is covered by this one
+    c->unacked_segments = 0;
+    timer_cancel(&w->timers, &c->ack_timer);
+    
+    memset(&ack_pkt->header, 0, sizeof(ack_pkt->header));
+    ack_pkt->header.ack_num = c->next_expected_seq;
+    ack_pkt->header.flags = SHAM_ACK;
+    ack_pkt->header.window_size = advertised_window(c, SHAM_ACK);
+    if (c->fec_rebuilt) {
+        ack_pkt->header.flags |= SHAM_FEC;
+        c->fec_rebuilt = false;
+    }
+    
+    int num_blocks = reasm_sack_blocks(&c->reasm, (struct sham_sack_block *)ack_pkt->data,
+                                       SHAM_MAX_SACK_BLOCKS, recent_seq);
     
-    next_expected_seq = pkt.header.seq_num;
+    if (num_blocks > 0) {
+        ack_pkt->header.flags |= SHAM_SACK;
+        log_event("SND ACK=%u WIN=%u SACK=%d", c->next_expected_seq, c->receiver_window, num_blocks);
+    } else {
+        log_event("SND ACK=%u WIN=%u", c->next_expected_seq, c->receiver_window);
+    }
+    uint32_t sack_len = num_blocks * sizeof(struct sham_sack_block);
+    sham_checksum_set(&ack_pkt->header, ack_pkt->data, sack_len);
+    send_batch_add(&w->tx_batch, &c->addr, ack_pkt, SHAM_HEADER_SIZE + sack_len, NULL, 0);
+}
+
+// Delayed ACK deadline: acknowledge the in-order data still waiting
+void on_ack_timer(struct timer *t, void *ctx) {
+    struct worker *w = ctx;
+    struct connection *c = TIMER_CONTAINER(t, struct connection, ack_timer);
+    
+    log_event("DELAYED ACK SEGMENTS=%u", c->unacked_segments);
+    w->data_acks++;
+    w->timer_acks++;
+    send_ack(w, c, c->next_expected_seq);
+}
+
+// Hand a contiguous in-order run to the writer and the running digest,
+// checkpointing a resumable transfer every CKPT_INTERVAL_BYTES. Staged
+// bytes count against the window, so they are written out before they
+// take half the receive buffer. Returns -1, having delivered nothing, once
+// the output file cannot be written.
+int deliver_in_order(struct worker *w, struct connection *c, const struct iovec *iov, int iovcnt) {
+    if (writer_append(&c->writer, iov, iovcnt) < 0 ||
+        (c->writer.committed - c->writer.flushed >= receive_buffer(w, c) / 2 && writer_flush(&c->writer) < 0)) {
+        log_event("WRITE FAILED: %s", strerror(c->writer.error));
+        return -1;
+    }
+    for (int i = 0; i < iovcnt; i++) {
+        digest_update(&c->rx_digest, iov[i].iov_base, iov[i].iov_len);
+        c->next_expected_seq += iov[i].iov_len;
+    }
+    if (c->resumable && c->writer.committed - c->checkpointed >= CKPT_INTERVAL_BYTES) {
+        save_checkpoint(c);
+    }
     return 0;
 }
 
-// Handle data reception
-void handle_data_transfer(int sockfd, struct sockaddr_in *client_addr, const char *output_filename) {
-    struct sham_packet pkt;
-    uint32_t data_len;
+// FIN: verify the digest, then acknowledge it and send our own FIN. A
+// repeated FIN means those were lost, so they are sent again.
+void handle_fin(struct worker *w, struct connection *c, struct sham_packet *pkt, uint32_t data_len) {
+    log_event("RCV FIN SEQ=%u", pkt->header.seq_num);
     
-    while (1) {
-        int ret = recv_packet(sockfd, &pkt, client_addr, &data_len);
-        if (ret <= 0) {
-            if (ret == 0) continue; // Timeout, keep waiting
-            break;
+    if (c->state == STATE_ESTABLISHED) {
+        // Everything before the FIN has been delivered, so the digest is
+        // complete: check it against the one the sender computed
+        size_t digest_len = digest_final(&c->rx_digest, c->rx_digest_value);
+        if (sham_opt_get(pkt->data, data_len, SHAM_OPT_DIGEST_VALUE, c->sender_digest, digest_len)) {
+            c->sender_digest_present = true;
+            c->digest_verified = memcmp(c->rx_digest_value, c->sender_digest, digest_len) == 0;
+            log_event("DIGEST %s", c->digest_verified ? "VERIFIED" : "MISMATCH");
+        }
+        c->state = STATE_LAST_ACK;
+        timer_arm(&w->timers, &c->idle_timer, w->now_ms + CONN_LINGER_MS);
+    }
+    
+    // The ACK for the FIN covers any data ACK still being delayed
+    c->unacked_segments = 0;
+    timer_cancel(&w->timers, &c->ack_timer);
+    
+    log_event("SND ACK FOR FIN");
+    queue_control(w, c, 0, pkt->header.seq_num + 1, SHAM_ACK, NULL, 0);
+    // Our FIN carries the digest of what arrived, so the client learns
+    // whether the file made it intact
+    uint8_t opts[2 + DIGEST_MAX_LENGTH];
+    uint32_t opt_len = 0;
+    if (!chat_mode) {
+        sham_opt_put(opts, &opt_len, sizeof(opts), SHAM_OPT_DIGEST_VALUE, c->rx_digest_value,
+                     digest_length(c->digest_alg));
+    }
+    log_event("SND FIN SEQ=%u", c->next_expected_seq);
+    queue_control(w, c, c->next_expected_seq, 0, SHAM_FIN, opts, opt_len);
+}
+
+// Take a data segment, as it arrived or as parity rebuilt it: decode it,
+// then deliver or hold it, and acknowledge it. Once the output file has
+// failed nothing more is delivered or acknowledged.
+void receive_data(struct worker *w, struct connection *c, struct sham_packet *pkt, uint32_t data_len) {
+    if (c->writer.error) {
+        log_event("DROP DATA SEQ=%u (output file failed)", pkt->header.seq_num);
+        return;
+    }
+    
+    // A compressed segment is decoded before anything else sees it, so
+    // from here on its length is the stream bytes it carries. One that
+    // will not decode is dropped, like a damaged datagram.
+    const uint8_t *payload = pkt->data;
+    if (pkt->header.flags & SHAM_COMPRESSED) {
+        int n = -1;
+        if (c->compress_alg != COMPRESS_NONE) {
+            n = compress_decode(&c->compress_stats, pkt->data, data_len, w->inflate_buffer, c->mss);
         }
+        if (n <= 0) {
+            log_event("DROP DATA SEQ=%u (bad compressed block)", pkt->header.seq_num);
+            return;
+        }
+        payload = w->inflate_buffer;
+        data_len = n;
+    } else if (c->compress_alg != COMPRESS_NONE) {
+        compress_count_raw(&c->compress_stats, data_len);
+    }
+    log_event("RCV DATA SEQ=%u LEN=%u", pkt->header.seq_num, data_len);
+    
+    uint32_t seq = pkt->header.seq_num;
+    bool ack_now = true;
+    w->data_segments++;
+    
+    if (reasm_insert(&c->reasm, seq, payload, data_len) == REASM_IN_ORDER) {
+        // The segment, plus any run held behind the hole it fills, goes
+        // to the file in one go
+        struct iovec run[1 + REASM_SLOTS];
+        run[0].iov_base = (void *)payload;
+        run[0].iov_len = data_len;
+        reasm_advance(&c->reasm, data_len);
         
-        // Check for FIN
-        if (pkt.header.flags & SHAM_FIN) {
-            log_event("RCV FIN SEQ=%u", pkt.header.seq_num);
-            
-            // Send ACK for FIN
-            struct sham_packet ack_pkt;
-            memset(&ack_pkt, 0, sizeof(ack_pkt));
-            ack_pkt.header.ack_num = pkt.header.seq_num + 1;
-            ack_pkt.header.flags = SHAM_ACK;
-            ack_pkt.header.window_size = receiver_window;
-            log_event("SND ACK FOR FIN");
-            send_packet(sockfd, client_addr, &ack_pkt, 0);
-            
-            // Send our FIN
-            memset(&ack_pkt, 0, sizeof(ack_pkt));
-            ack_pkt.header.seq_num = next_expected_seq;
-            ack_pkt.header.flags = SHAM_FIN;
-            ack_pkt.header.window_size = receiver_window;
-            log_event("SND FIN SEQ=%u", next_expected_seq);
-            send_packet(sockfd, client_addr, &ack_pkt, 0);
-            
-            // Wait for final ACK
-            recv_packet(sockfd, &pkt, client_addr, &data_len);
-            log_event("RCV ACK=%u", pkt.header.ack_num);
-            
-            break;
+        int num_slots = reasm_contiguous(&c->reasm, run + 1, REASM_SLOTS);
+        if (num_slots > 0) {
+            log_event("REASM DELIVER %d SEGMENTS", num_slots);
+        }
+        if (deliver_in_order(w, c, run, 1 + num_slots) < 0) {
+            return;
         }
+        reasm_release(&c->reasm, num_slots);
         
-        // Simulate packet loss
-        if (should_drop_packet() && data_len > 0) {
-            log_event("DROP DATA SEQ=%u", pkt.header.seq_num);
-            continue;
+        // Plain in-order data may wait for company; data that fills a
+        // hole, or leaves one behind, is reported at once
+        if (num_slots == 0 && c->reasm.held_segments == 0) {
+            c->unacked_segments++;
+            ack_now = c->unacked_segments >= ack_every || ack_delay_ms == 0;
         }
+    }
+    
+    // Out-of-order data and duplicates are acknowledged immediately, so
+    // holes are reported and lost ACKs repaired without delay
+    if (ack_now) {
+        w->data_acks++;
+        send_ack(w, c, seq);
+    } else if (!timer_pending(&c->ack_timer)) {
+        timer_arm(&w->timers, &c->ack_timer, w->now_ms + ack_delay_ms);
+    }
+}
+
+// Parity: rebuild the segment of its block that is missing, if only one
+// is, and take it as if it had arrived. The next ACK tells the sender, so
+// its loss estimate counts what parity repaired.
+void handle_parity(struct worker *w, struct connection *c, struct sham_packet *pkt, uint32_t data_len) {
+    log_event("RCV PARITY SEQ=%u LEN=%u", pkt->header.seq_num, data_len);
+    if (!c->fec) return;
+    
+    int n = fec_rebuild(&c->fec_rx, pkt, data_len, c->next_expected_seq, &w->rebuild_buffer);
+    if (n <= 0) return;
+    log_event("FEC REBUILT SEQ=%u LEN=%d", w->rebuild_buffer.header.seq_num, n);
+    c->fec_rebuilt = true;
+    receive_data(w, c, &w->rebuild_buffer, n);
+}
+
+// Handle one packet of an established transfer
+void handle_transfer_packet(struct worker *w, struct connection *c, struct sham_packet *pkt, uint32_t data_len) {
+    if (pkt->header.flags & SHAM_FIN) {
+        handle_fin(w, c, pkt, data_len);
+        return;
+    }
+    
+    // Answer zero-window probes with the current window
+    if (pkt->header.flags & SHAM_PROBE) {
+        log_event("RCV PROBE");
+        send_ack(w, c, pkt->header.seq_num);
+        return;
+    }
+    
+    // Simulate packet loss
+    if (should_drop_packet(w) && data_len > 0) {
+        log_event("DROP DATA SEQ=%u", pkt->header.seq_num);
+        return;
+    }
+    
+    // Parity, or data, which is kept in case parity has to rebuild a
+    // segment next to it
+    if (pkt->header.flags & SHAM_FEC) {
+        handle_parity(w, c, pkt, data_len);
+    } else if (data_len > 0) {
+        if (c->fec) {
+            fec_store(&c->fec_rx, pkt, data_len);
+        }
+        receive_data(w, c, pkt, data_len);
+    }
+}
+
+// Report on a parallel transfer once its last stream has closed. The
+// combined digest is taken over the range digests, as the client does.
+void report_transfer(struct transfer *t) {
+    const char *alg = digest_name(t->digest_alg);
+    flockfile(stdout);
+    if (t->ranges_done == t->num_streams) {
+        uint8_t combined[DIGEST_MAX_LENGTH];
+        char hex[2 * DIGEST_MAX_LENGTH + 1];
+        size_t len = digest_combine(t->digest_alg, t->range_digests, t->num_streams, combined);
+        digest_hex(combined, len, hex);
+        printf("Parallel transfer complete: %s, %llu bytes in %u ranges\n",
+               t->filename, (unsigned long long)t->bytes, t->num_streams);
+        printf("Combined %s: %s\n", alg, hex);
+        if (t->ranges_verified == t->num_streams) {
+            printf("Combined digest verified against sender\n");
+        } else {
+            printf("DIGEST MISMATCH in %u of %u ranges\n",
+                   t->num_streams - t->ranges_verified, t->num_streams);
+        }
+    } else {
+        printf("Parallel transfer incomplete: %s, %u of %u ranges received\n",
+               t->fd >= 0 ? t->filename : "no file", t->ranges_done, t->num_streams);
+    }
+    funlockfile(stdout);
+}
+
+// Close the output file, report on the transfer and drop the connection
+void conn_close(struct worker *w, struct connection *c, bool completed) {
+    if (c->writer.fd >= 0) {
+        // Flush the tail of the file; the digest already covers every byte
+        uint64_t received_bytes = c->writer.committed;
+        uint32_t write_calls = c->writer.write_calls;
+        size_t digest_len = digest_length(c->digest_alg);
+        char hex[2 * DIGEST_MAX_LENGTH + 1];
         
-        // Handle data packet
-        if (data_len > 0) {
-            log_event("RCV DATA SEQ=%u LEN=%u", pkt.header.seq_num, data_len);
-            
-            // Store data if in-order
-            if (pkt.header.seq_num == next_expected_seq) {
-                memcpy(recv_buffer + recv_buffer_size, pkt.data, data_len);
-                recv_buffer_size += data_len;
-                next_expected_seq += data_len;
-                
-                // Send ACK
-                struct sham_packet ack_pkt;
-                memset(&ack_pkt, 0, sizeof(ack_pkt));
-                ack_pkt.header.ack_num = next_expected_seq;
-                ack_pkt.header.flags = SHAM_ACK;
-                ack_pkt.header.window_size = receiver_window;
-                log_event("SND ACK=%u WIN=%u", next_expected_seq, receiver_window);
-                send_packet(sockfd, client_addr, &ack_pkt, 0);
-            }
+        // A resumable transfer that stopped short keeps its place for the
+        // next connection; one that finished needs it no more
+        if (c->resumable && !completed) {
+            save_checkpoint(c);
+        } else if (c->resumable) {
+            checkpoint_remove(c->output_filename);
+        }
+        
+        // A write that failed at any point leaves the file short, whatever
+        // the digest of the stream says
+        bool written = writer_close(&c->writer) == 0 && !c->writer.error;
+        if (written && completed && received_bytes > 0) {
+            digest_hex(c->rx_digest_value, digest_len, hex);
+            conn_printf(c, "%s: %s\n", digest_name(c->digest_alg), hex);
+        }
+        if (!written) {
+            conn_printf(c, "WRITE FAILED: %s is incomplete (%s)\n", c->output_filename, strerror(c->writer.error));
+        } else if (c->sender_digest_present && c->digest_verified) {
+            conn_printf(c, "Digest verified against sender\n");
+        } else if (c->sender_digest_present) {
+            digest_hex(c->sender_digest, digest_len, hex);
+            conn_printf(c, "DIGEST MISMATCH: sender reported %s\n", hex);
         }
+        conn_printf(c, "Received %llu bytes in %u writes\n", (unsigned long long)received_bytes, write_calls);
+        
+        if (c->reasm.total_stored > 0) {
+            conn_printf(c, "Out-of-order segments reassembled: %llu\n",
+                        (unsigned long long)c->reasm.total_stored);
+        }
+        if (c->compress_alg != COMPRESS_NONE) {
+            const struct compress_stats *st = &c->compress_stats;
+            conn_printf(c, "Compression: %s, %llu bytes received as %llu (ratio %.2f), %llu of %llu segments compressed\n",
+                        compress_name(c->compress_alg), (unsigned long long)st->raw_bytes,
+                        (unsigned long long)st->wire_bytes,
+                        st->wire_bytes ? (double)st->raw_bytes / st->wire_bytes : 1.0,
+                        (unsigned long long)st->compressed, (unsigned long long)st->segments);
+            conn_printf(c, "Decompression CPU: %.1f ms (%.1f MB/s)\n", st->busy_us / 1000.0,
+                        st->busy_us ? (double)st->raw_bytes / st->busy_us : 0.0);
+        }
+        if (c->fec) {
+            const struct fec_stats *st = &c->fec_rx.stats;
+            conn_printf(c, "FEC: %llu segments rebuilt from %llu parity segments, %llu blocks lost more than one\n",
+                        (unsigned long long)st->rebuilt, (unsigned long long)st->parity_segments,
+                        (unsigned long long)st->unrecoverable);
+        }
+        if (!completed) {
+            conn_printf(c, "Transfer incomplete: no FIN from the client\n");
+        }
+        if (c->resumable && !completed) {
+            conn_printf(c, "Checkpoint kept at byte %llu; the client can continue with --resume\n",
+                        (unsigned long long)(c->writer.base_offset + c->checkpointed));
+        }
+        if (c->transfer && completed) {
+            transfer_range_done(c->transfer, c->stream.index, c->rx_digest_value,
+                                c->digest_verified && written, received_bytes);
+        }
+    }
+    
+    // The last stream out reports on the whole file
+    if (c->transfer && transfer_leave(c->transfer)) {
+        report_transfer(c->transfer);
+        transfer_free(c->transfer);
+    }
+    c->transfer = NULL;
+    
+    if (c == chat_connection) {
+        chat_connection = NULL;
+    }
+    reasm_free(&c->reasm);
+    fec_decoder_free(&c->fec_rx);
+    timer_cancel(&w->timers, &c->idle_timer);
+    timer_cancel(&w->timers, &c->ack_timer);
+    conn_destroy(&w->connections, c);
+    w->closed_connections++;
+}
+
+// How long a connection in its current state may hear nothing from the peer
+uint32_t conn_timeout_ms(const struct connection *c) {
+    switch (c->state) {
+    case STATE_ESTABLISHED:
+        return CONN_IDLE_TIMEOUT_MS;
+    case STATE_LAST_ACK:
+        return CONN_LINGER_MS;
+    default:
+        return CONN_HANDSHAKE_TIMEOUT_MS;
     }
+}
+
+// Connection deadline. Traffic does not re-arm the timer; instead, when it
+// fires, a peer heard from since is given the rest of its time. A
+// connection waiting only for the final ACK of the close has a complete
+// file and just lingers briefly.
+void on_conn_timer(struct timer *t, void *ctx) {
+    struct worker *w = ctx;
+    struct connection *c = TIMER_CONTAINER(t, struct connection, idle_timer);
     
-    // Write received data to file
-    if (output_filename && recv_buffer_size > 0) {
-        FILE *f = fopen(output_filename, "wb");
-        if (f) {
-            fwrite(recv_buffer, 1, recv_buffer_size, f);
-            fclose(f);
-            
-            // Calculate and print MD5
-            unsigned char md5_hash[MD5_DIGEST_LENGTH];
-            MD5(recv_buffer, recv_buffer_size, md5_hash);
-            
-            printf("MD5: ");
-            for (int i = 0; i < MD5_DIGEST_LENGTH; i++) {
-                printf("%02x", md5_hash[i]);
+    uint64_t deadline = c->last_activity_ms + conn_timeout_ms(c);
+    if (deadline > w->now_ms) {
+        timer_arm(&w->timers, t, deadline);
+        return;
+    }
+    
+    if (c->state == STATE_LAST_ACK) {
+        w->completed_connections++;
+        conn_close(w, c, true);
+    } else if (c->state == STATE_ESTABLISHED) {
+        conn_close(w, c, false);
+    } else {
+        log_event("HANDSHAKE TIMEOUT");
+        conn_close(w, c, false);
+    }
+}
+
+// Whether a SYN is for another stream of a parallel transfer in progress.
+// Those are let in past the connection limit, so a server without --multi
+// still takes every stream of the one transfer it serves.
+bool syn_joins_transfer(struct sockaddr_in *src, struct sham_packet *pkt, uint32_t data_len) {
+    struct sham_stream_opt stream;
+    return sham_opt_get(pkt->data, data_len, SHAM_OPT_STREAM, &stream, sizeof(stream)) &&
+           transfer_active(src->sin_addr.s_addr, stream.transfer_id);
+}
+
+// A SYN resuming a transfer whose connection is still open here: the
+// client gave up on it and reconnected from a new port. The old connection
+// is checkpointed and closed, so the new one continues from where it
+// stopped instead of waiting out CONN_IDLE_TIMEOUT_MS. Only this worker's
+// connections are searched.
+void close_superseded(struct worker *w, struct sockaddr_in *src, struct sham_packet *pkt, uint32_t data_len) {
+    struct sham_resume_opt resume;
+    if (chat_mode || !sham_opt_get(pkt->data, data_len, SHAM_OPT_RESUME, &resume, sizeof(resume))) {
+        return;
+    }
+    for (uint32_t b = 0; b < w->connections.num_buckets; b++) {
+        for (struct connection *c = w->connections.buckets[b]; c; c = c->hash_next) {
+            if (c->resumable && c->resume_id == resume.transfer_id) {
+                log_event("RESUME SUPERSEDES CONNECTION %u", c->id);
+                conn_printf(c, "Client reconnected to resume the transfer\n");
+                if (c->state == STATE_LAST_ACK) {
+                    w->completed_connections++;
+                }
+                conn_close(w, c, c->state == STATE_LAST_ACK);
+                return;
             }
-            printf("\n");
         }
     }
 }
 
-// Handle chat mode
-void handle_chat_mode(int sockfd, struct sockaddr_in *client_addr) {
-    fd_set read_fds;
-    struct sham_packet pkt;
-    uint32_t data_len;
+// Route one datagram to its connection and drive that connection's state
+// machine. A corrupted datagram goes no further: the sender repairs it
+// like a lost one, segment by segment.
+void handle_datagram(struct worker *w, struct sockaddr_in *src, struct sham_packet *pkt, uint32_t data_len) {
+    if (!sham_checksum_ok(pkt, data_len)) {
+        log_event("DROP CORRUPT SEQ=%u LEN=%u", pkt->header.seq_num, data_len);
+        w->checksum_errors++;
+        return;
+    }
+    uint16_t flags = pkt->header.flags;
+    if (flags & SHAM_PMTU) {
+        answer_pmtu_probe(w, src, data_len);
+        return;
+    }
+    struct connection *c = conn_lookup(&w->connections, src);
     
-    printf("Chat mode started. Type /quit to exit.\n");
+    if (!c) {
+        // Only a SYN opens a connection
+        if (!(flags & SHAM_SYN) || (flags & SHAM_ACK)) {
+            return;
+        }
+        close_superseded(w, src, pkt, data_len);
+        if (w->connections.count >= max_connections && !syn_joins_transfer(src, pkt, data_len)) {
+            log_event("DROP SYN: %u connections open", w->connections.count);
+            return;
+        }
+        c = conn_create(&w->connections, src);
+        if (!c) {
+            perror("Failed to allocate connection");
+            return;
+        }
+        timer_init(&c->idle_timer, on_conn_timer);
+        timer_init(&c->ack_timer, on_ack_timer);
+        timer_arm(&w->timers, &c->idle_timer, w->now_ms + CONN_HANDSHAKE_TIMEOUT_MS);
+    }
+    c->last_activity_ms = w->now_ms;
+    
+    // A data segment is never longer than the segment size. One that is,
+    // from a broken peer or coalesced by GRO, would put the reassembly
+    // ring out of step. Parity carries a header of its own.
+    if (c->mss > 0 && data_len > c->mss && !(flags & (SHAM_SYN | SHAM_FIN | SHAM_FEC))) {
+        log_event("DROP DATA SEQ=%u LEN=%u (longer than MSS %u)", pkt->header.seq_num, data_len, c->mss);
+        return;
+    }
     
-    while (1) {
-        FD_ZERO(&read_fds);
-        FD_SET(STDIN_FILENO, &read_fds);
-        FD_SET(sockfd, &read_fds);
+    switch (c->state) {
+    case STATE_CLOSED:
+    case STATE_SYN_RECEIVED:
+        if (flags & SHAM_SYN) {
+            handle_syn(w, c, pkt, data_len);
+            return;
+        }
+        // The final ACK of the handshake, or data that overtook a lost one
+        if (conn_establish(c) < 0) {
+            conn_close(w, c, false);
+            return;
+        }
+        if (chat_mode || (data_len == 0 && !(flags & (SHAM_FIN | SHAM_PROBE)))) {
+            return;
+        }
+        handle_transfer_packet(w, c, pkt, data_len);
+        break;
         
-        struct timeval tv = {1, 0};
-        int ret = select(sockfd + 1, &read_fds, NULL, NULL, &tv);
+    case STATE_ESTABLISHED:
+        handle_transfer_packet(w, c, pkt, data_len);
+        break;
         
-        if (ret < 0) {
-            perror("select");
+    case STATE_LAST_ACK:
+        if (flags & SHAM_FIN) {
+            handle_fin(w, c, pkt, data_len);
+        } else if (flags & SHAM_ACK) {
+            log_event("RCV ACK=%u", pkt->header.ack_num);
+            w->completed_connections++;
+            conn_close(w, c, true);
+        }
+        break;
+        
+    default:
+        break;
+    }
+}
+
+// Worker event loop: demultiplex datagrams to connections by peer address.
+// Without --multi it returns once the single connection, or every stream
+// of a parallel transfer, has closed; in chat mode, once it is established.
+void *serve(void *arg) {
+    struct worker *w = arg;
+    
+    if (w->cpu >= 0) {
+        pin_current_thread(w->cpu);
+    }
+    send_batch_init(&w->tx_batch, w->sockfd, &w->io_stats);
+    recv_batch_init(&w->rx_batch, &w->io_stats);
+    if (offload) {
+        // Clients send runs of full-sized segments, which arrive coalesced
+        recv_batch_enable_gro(&w->rx_batch, w->sockfd);
+        send_batch_enable_gso(&w->tx_batch);
+    }
+    
+    while (!stop_requested) {
+        if (!multi_mode && w->closed_connections > 0 && w->connections.count == 0) break;
+        if (chat_mode && chat_connection) break;
+        
+        // Take every datagram that is already queued in one call. Readiness
+        // is edge-triggered, so only once the socket is empty does the
+        // worker sleep: until a datagram, the next deadline or a stop.
+        int count = recv_batch_drain(w->sockfd, &w->rx_batch);
+        if (count < 0) {
+            perror("recvmmsg failed");
             break;
         }
+        if (count == 0) {
+            reactor_set_deadline(&w->reactor, timer_wheel_next(&w->timers));
+            reactor_wait(&w->reactor, -1);
+        }
+        w->now_ms = timer_now_ms();
+        
+        for (int i = 0; i < count; i++) {
+            handle_datagram(w, &w->rx_batch.src[i], w->rx_batch.pkts[i],
+                            w->rx_batch.len[i] - SHAM_HEADER_SIZE);
+        }
+        timer_wheel_advance(&w->timers, w->now_ms, w);
+        
+        // One sendmmsg for all the replies this batch produced
+        send_batch_flush(&w->tx_batch);
+    }
+    
+    if (chat_mode) return NULL;
+    
+    // Shutting down: close whatever is still open
+    for (uint32_t b = 0; b < w->connections.num_buckets; b++) {
+        struct connection *c = w->connections.buckets[b];
+        while (c) {
+            struct connection *next = c->hash_next;
+            if (c->state == STATE_LAST_ACK) {
+                w->completed_connections++;
+            }
+            conn_close(w, c, c->state == STATE_LAST_ACK);
+            c = next;
+        }
+    }
+    return NULL;
+}
+
+// Print datagrams moved and the syscalls it took
+void print_io_stats(const char *label, const struct io_stats *st) {
+    printf("%s: %llu packets in %llu receive calls (%.1f/call), %llu packets in %llu send calls (%.1f/call)\n",
+           label, (unsigned long long)st->packets_received, (unsigned long long)st->recv_calls,
+           st->recv_calls ? (double)st->packets_received / st->recv_calls : 0.0,
+           (unsigned long long)st->packets_sent, (unsigned long long)st->send_calls,
+           st->send_calls ? (double)st->packets_sent / st->send_calls : 0.0);
+    if (st->gro_buffers > 0 || st->gso_sends > 0) {
+        printf("%s offload: %llu packets coalesced into %llu GRO buffers, %llu packets in %llu GSO sends\n",
+               label, (unsigned long long)st->gro_packets, (unsigned long long)st->gro_buffers,
+               (unsigned long long)st->gso_packets, (unsigned long long)st->gso_sends);
+    }
+    if (st->truncated > 0) {
+        printf("%s: %llu oversized datagrams dropped\n", label, (unsigned long long)st->truncated);
+    }
+}
+
+// Report per-worker and overall totals
+void print_summary(void) {
+    struct io_stats total = {0};
+    uint32_t completed = 0, closed = 0;
+    uint64_t data_segments = 0, data_acks = 0, timer_acks = 0, checksum_errors = 0;
+    
+    for (int i = 0; i < num_workers; i++) {
+        struct worker *w = &workers[i];
+        if (num_workers > 1) {
+            char label[32];
+            printf("Worker %d: %u of %u connections completed\n", i,
+                   w->completed_connections, w->closed_connections);
+            snprintf(label, sizeof(label), "Worker %d I/O", i);
+            print_io_stats(label, &w->io_stats);
+        }
+        total.packets_received += w->io_stats.packets_received;
+        total.recv_calls += w->io_stats.recv_calls;
+        total.packets_sent += w->io_stats.packets_sent;
+        total.send_calls += w->io_stats.send_calls;
+        total.gso_sends += w->io_stats.gso_sends;
+        total.gso_packets += w->io_stats.gso_packets;
+        total.gro_buffers += w->io_stats.gro_buffers;
+        total.gro_packets += w->io_stats.gro_packets;
+        total.truncated += w->io_stats.truncated;
+        completed += w->completed_connections;
+        closed += w->closed_connections;
+        data_segments += w->data_segments;
+        data_acks += w->data_acks;
+        timer_acks += w->timer_acks;
+        checksum_errors += w->checksum_errors;
+    }
+    
+    if (multi_mode) {
+        printf("Connections completed: %u of %u\n", completed, closed);
+    }
+    printf("ACKs: %llu for %llu data segments (%llu saved, %llu sent by the delay timer)\n",
+           (unsigned long long)data_acks, (unsigned long long)data_segments,
+           (unsigned long long)(data_segments - data_acks), (unsigned long long)timer_acks);
+    if (checksum_errors > 0) {
+        printf("Checksum errors: %llu corrupted datagrams dropped\n", (unsigned long long)checksum_errors);
+    }
+    print_io_stats("I/O", &total);
+}
+
+// Open the listening socket of one worker. A lone worker keeps a plain
+// socket; several share the port through SO_REUSEPORT.
+int open_worker_socket(int port) {
+    // A scaled window, or many concurrent senders, can burst far more than
+    // the default socket buffer holds; give the kernel room to queue them
+    int rcvbuf = CONN_SOCKET_BUFFER;
+    int sockfd;
+    
+    if (num_workers > 1) {
+        sockfd = reuseport_open(port, rcvbuf);
+    } else {
+        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sockfd < 0) {
+            perror("socket");
+            return -1;
+        }
+        if (rcvbuf > 0) {
+            setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+        
+        struct sockaddr_in server_addr;
+        memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(port);
+        
+        if (bind(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+            perror("bind");
+            close(sockfd);
+            return -1;
+        }
+    }
+    return sockfd;
+}
+
+// Handle chat mode
+void handle_chat_mode(struct worker *w, struct connection *c) {
+    struct sockaddr_in *client_addr = &c->addr;
+    struct sham_packet pkt;
+    bool peer_closed = false;
+    
+    // Input is line-buffered by stdio, so it stays level-triggered
+    if (reactor_add(&w->reactor, STDIN_FILENO, REACTOR_STDIN, false) < 0) {
+        perror("Failed to watch stdin");
+        return;
+    }
+    printf("Chat mode started. Type /quit to exit.\n");
+    
+    while (!peer_closed && !stop_requested) {
+        uint32_t ready = reactor_wait(&w->reactor, -1);
         
         // Check stdin
-        if (FD_ISSET(STDIN_FILENO, &read_fds)) {
+        if (ready & REACTOR_STDIN) {
             char line[SHAM_DATA_SIZE];
             if (fgets(line, sizeof(line), stdin)) {
                 if (strncmp(line, "/quit", 5) == 0) {
                     // Send FIN
                     memset(&pkt, 0, sizeof(pkt));
-                    pkt.header.seq_num = next_expected_seq;
+                    pkt.header.seq_num = c->next_expected_seq;
                     pkt.header.flags = SHAM_FIN;
-                    send_packet(sockfd, client_addr, &pkt, 0);
+                    send_packet(w->sockfd, client_addr, &pkt, 0);
                     break;
                 }
                 
                 // Send message
                 memset(&pkt, 0, sizeof(pkt));
-                pkt.header.seq_num = next_expected_seq;
+                pkt.header.seq_num = c->next_expected_seq;
                 pkt.header.flags = 0;
                 size_t len = strlen(line);
                 memcpy(pkt.data, line, len);
-                send_packet(sockfd, client_addr, &pkt, len);
-                next_expected_seq += len;
+                send_packet(w->sockfd, client_addr, &pkt, len);
+                c->next_expected_seq += len;
             }
         }
         
-        // Check socket
-        if (FD_ISSET(sockfd, &read_fds)) {
-            if (recv_packet(sockfd, &pkt, client_addr, &data_len) > 0) {
-                if (pkt.header.flags & SHAM_FIN) {
-                    break;
-                }
-                if (data_len > 0) {
-                    printf("Peer: %.*s", (int)data_len, pkt.data);
+        // Check socket, reading until it is empty
+        if (ready & REACTOR_SOCKET) {
+            int count;
+            while (!peer_closed && (count = recv_batch_drain(w->sockfd, &w->rx_batch)) > 0) {
+                for (int i = 0; i < count; i++) {
+                    uint32_t data_len = w->rx_batch.len[i] - SHAM_HEADER_SIZE;
+                    if (!sham_checksum_ok(w->rx_batch.pkts[i], data_len)) {
+                        w->checksum_errors++;
+                        continue;
+                    }
+                    if (w->rx_batch.pkts[i]->header.flags & SHAM_FIN) {
+                        peer_closed = true;
+                        break;
+                    }
+                    if (data_len > 0) {
+                        printf("Peer: %.*s", (int)data_len, w->rx_batch.pkts[i]->data);
+                    }
                 }
             }
         }
@@ -313,7 +1176,7 @@ void handle_chat_mode(int sockfd, struct sockaddr_in *client_addr) {
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <port> [--chat] [loss_rate]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <port> [--chat | --multi] [--workers=N] [--steer=kernel|hash|cpu] [--pin] [--ack-every=N] [--ack-delay=MS] [--no-offload] [loss_rate]\n", argv[0]);
         return 1;
     }
     
@@ -323,59 +1186,138 @@ int main(int argc, char *argv[]) {
     for (int i = 2; i < argc; i++) {
         if (strcmp(argv[i], "--chat") == 0) {
             chat_mode = true;
+        } else if (strcmp(argv[i], "--multi") == 0) {
+            multi_mode = true;
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            // Worker per core; 0 means one per online CPU
+            num_workers = atoi(argv[i] + 10);
+            if (num_workers <= 0) num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            if (num_workers <= 0) num_workers = 1;
+            multi_mode = true;
+        } else if (strncmp(argv[i], "--steer=", 8) == 0) {
+            if (!steer_lookup(argv[i] + 8, &steer_mode)) {
+                fprintf(stderr, "Unknown steering '%s' (available: kernel, hash, cpu)\n", argv[i] + 8);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--pin") == 0) {
+            pin_workers = true;
+        } else if (strncmp(argv[i], "--ack-every=", 12) == 0) {
+            // 1 acknowledges every segment, as without delayed ACKs
+            int n = atoi(argv[i] + 12);
+            ack_every = n > 0 ? (uint32_t)n : 1;
+        } else if (strncmp(argv[i], "--ack-delay=", 12) == 0) {
+            int ms = atoi(argv[i] + 12);
+            ack_delay_ms = ms > 0 ? (uint32_t)ms : 0;
+        } else if (strcmp(argv[i], "--no-offload") == 0) {
+            offload = false;
         } else {
             loss_rate = atof(argv[i]);
         }
     }
     
-    srand(time(NULL));
-    init_logging("server_log.txt");
-    
-    // Create UDP socket
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) {
-        perror("socket");
+    if (chat_mode && multi_mode) {
+        fprintf(stderr, "--chat cannot be combined with --multi or --workers\n");
         return 1;
     }
     
-    // Set socket timeout
-    struct timeval tv = {2, 0};
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (multi_mode) {
+        max_connections = SHAM_MAX_CONNECTIONS;
+        raise_file_limit();
+    }
     
-    // Bind socket
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
+    workers = calloc(num_workers, sizeof(*workers));
+    if (!workers) {
+        perror("Failed to allocate workers");
+        return 1;
+    }
     
-    if (bind(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("bind");
-        close(sockfd);
+    // Stop cleanly on Ctrl-C: the handler writes to a pipe every worker's
+    // reactor watches, so each loop wakes up however long it meant to sleep
+    if (pipe(stop_pipe) < 0) {
+        perror("pipe");
         return 1;
     }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
     
-    printf("Server listening on port %d\n", port);
+    unsigned int seed = (unsigned int)time(NULL);
+    init_logging("server_log.txt");
+    log_event("CRC32C=%s", crc32c_init());
     
-    // Handle connection
-    struct sockaddr_in client_addr;
-    if (handle_handshake(sockfd, &client_addr) < 0) {
-        fprintf(stderr, "Handshake failed\n");
-        close(sockfd);
-        close_logging();
-        return 1;
+    // Sockets are bound in worker order, which is the index a steering
+    // program selects. Connection ids are interleaved so output files
+    // never collide across workers.
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 0; i < num_workers; i++) {
+        struct worker *w = &workers[i];
+        w->index = i;
+        w->rand_seed = seed + i;
+        w->cpu = pin_workers && num_cpus > 0 ? (int)(i % num_cpus) : -1;
+        w->sockfd = open_worker_socket(port);
+        if (w->sockfd < 0 || conn_table_init(&w->connections, i + 1, num_workers) < 0 ||
+            reactor_init(&w->reactor) < 0 ||
+            reactor_add(&w->reactor, w->sockfd, REACTOR_SOCKET, true) < 0 ||
+            reactor_add(&w->reactor, stop_pipe[0], REACTOR_STOP, false) < 0) {
+            fprintf(stderr, "Failed to set up worker %d\n", i);
+            return 1;
+        }
+        w->now_ms = timer_now_ms();
+        timer_wheel_init(&w->timers, w->now_ms);
+        
+        // The kernel reports twice the payload it budgets for; allow for
+        // per-datagram overhead by advertising at most half of that again
+        int rcvbuf = 0;
+        socklen_t rcvbuf_len = sizeof(rcvbuf);
+        getsockopt(w->sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &rcvbuf_len);
+        w->window_limit = rcvbuf > 4 * 65535 ? (uint32_t)rcvbuf / 4 : 65535;
+    }
+    if (num_workers > 1 && steer_mode != STEER_KERNEL &&
+        reuseport_attach_steering(workers[0].sockfd, steer_mode, num_workers) < 0) {
+        fprintf(stderr, "Falling back to kernel steering\n");
     }
     
-    printf("Connection established\n");
+    if (num_workers > 1) {
+        printf("Server listening on port %d with %d workers (up to %u concurrent connections each)\n",
+               port, num_workers, max_connections);
+    } else if (multi_mode) {
+        printf("Server listening on port %d (up to %u concurrent connections)\n", port, max_connections);
+    } else {
+        printf("Server listening on port %d\n", port);
+    }
     
-    // Handle data transfer or chat
-    if (chat_mode) {
-        handle_chat_mode(sockfd, &client_addr);
+    // One thread per worker; a lone worker runs on the main thread
+    if (num_workers == 1) {
+        serve(&workers[0]);
     } else {
-        handle_data_transfer(sockfd, &client_addr, "received_file");
+        for (int i = 0; i < num_workers; i++) {
+            if (pthread_create(&workers[i].thread, NULL, serve, &workers[i]) != 0) {
+                perror("pthread_create");
+                request_stop();
+                num_workers = i;
+                break;
+            }
+        }
+        for (int i = 0; i < num_workers; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+    
+    // Then the chat, if that is what was asked for
+    if (chat_mode && chat_connection) {
+        handle_chat_mode(&workers[0], chat_connection);
+    } else if (!chat_mode) {
+        print_summary();
     }
     
-    close(sockfd);
+    for (int i = 0; i < num_workers; i++) {
+        conn_table_free(&workers[i].connections);
+        reactor_close(&workers[i].reactor);
+        close(workers[i].sockfd);
+    }
+    free(workers);
     close_logging();
     return 0;
 }
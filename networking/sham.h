@@ -3,41 +3,121 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "timer_wheel.h"
+#include "crc32c.h"
 
 // S.H.A.M. Protocol Flags
 #define SHAM_SYN  0x1  // Synchronize - initiate connection
 #define SHAM_ACK  0x2  // Acknowledge
 #define SHAM_FIN  0x4  // Finish - terminate connection
+#define SHAM_SACK 0x8  // ACK payload carries selective acknowledgement blocks
+#define SHAM_PROBE 0x10 // Zero-window probe - elicit an ACK with the current window
+#define SHAM_PMTU 0x20  // Path MTU probe - padded to a candidate size, echoed with its length
+#define SHAM_COMPRESSED 0x40 // Data payload is a compressed block (see compress.h)
+#define SHAM_FEC 0x80   // Parity segment from the sender; on an ACK, a segment was rebuilt from parity
 
 // Protocol Constants
-#define SHAM_DATA_SIZE 1024        // Maximum data payload per packet
-#define SHAM_WINDOW_SIZE 10        // Sliding window size (packets)
-#define SHAM_TIMEOUT_MS 500        // Retransmission timeout (milliseconds)
+#define SHAM_DATA_SIZE 1024        // Default data payload per packet, used unless a larger one is negotiated
+#define SHAM_MAX_DATA_SIZE 8956    // Largest negotiable payload: a 9000-byte jumbo frame less the headers
+#define SHAM_WINDOW_SIZE 10        // Initial congestion window (packets)
+#define SHAM_MAX_WINDOW 1024       // Largest sliding window the sender tracks (packets)
+#define SHAM_TIMEOUT_MS 500        // Initial retransmission timeout, before any RTT sample (ms)
 #define SHAM_MAX_RETRIES 10        // Maximum retransmission attempts
+#define SHAM_SYN_RETRIES 5         // SYNs sent before the handshake fails
+#define SHAM_MAX_SACK_BLOCKS 4     // SACK blocks carried per ACK
+#define SHAM_DUP_THRESH 3          // SACKed segments above a hole before it is deemed lost
+#define SHAM_MAX_WSCALE 14         // Largest window scale shift, as in TCP (1 GB windows)
+#define SHAM_SEND_BUFFER (8 * 1024 * 1024)   // Sender socket buffer, so a scaled window fits
+#define SHAM_PMTU_WAIT_MS 100      // How long a round of path MTU probes waits for echoes
+#define SHAM_PMTU_ROUNDS 2         // Probe rounds before settling for the largest size echoed
+#define SHAM_MAX_STREAMS 16        // Connections one parallel transfer may use
+#define SHAM_STREAM_ALIGN (1024 * 1024)   // Ranges of a parallel transfer start at multiples of this
 #define SHAM_HEADER_SIZE sizeof(struct sham_header)   
-#define SHAM_PACKET_SIZE (SHAM_HEADER_SIZE + SHAM_DATA_SIZE)  
+#define SHAM_PACKET_SIZE (SHAM_HEADER_SIZE + SHAM_MAX_DATA_SIZE)  
+
+// Payload that fills an IPv4 datagram of the given MTU exactly
+#define SHAM_MTU_PAYLOAD(mtu) ((mtu) - 20 - 8 - (uint32_t)SHAM_HEADER_SIZE)
+
+// Sequence Number Arithmetic: the 32-bit sequence space wraps every 4 GB,
+// so numbers are compared by the sign of their difference (RFC 1982). This
+// is exact as long as the two are less than 2 GB apart, which any window is.
+static inline bool seq_lt(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+static inline bool seq_leq(uint32_t a, uint32_t b) { return (int32_t)(a - b) <= 0; }
+
+// Extend a sequence number from the wire to the 64-bit stream position
+// nearest ref, a position known to be within 2 GB of it
+static inline uint64_t seq_extend(uint64_t ref, uint32_t seq) {
+    return ref + (int64_t)(int32_t)(seq - (uint32_t)ref);
+}
 
 // S.H.A.M. Header Structure
 struct sham_header {
     uint32_t seq_num;      // Sequence number (byte-based)
     uint32_t ack_num;      // Acknowledgment number (next expected byte)
     uint16_t flags;        // Control flags (SYN, ACK, FIN)
-    uint16_t window_size;  // Flow control window size (bytes)
+    uint16_t window_size;  // Flow control window, in units of 2^wscale bytes
+    uint32_t checksum;     // CRC32C of the header up to here and the payload
 } __attribute__((packed));
 
 // S.H.A.M. Packet Structure
 struct sham_packet {
     struct sham_header header;
-    uint8_t data[SHAM_DATA_SIZE];
+    uint8_t data[SHAM_MAX_DATA_SIZE];
+} __attribute__((packed));
+
+// Segment Checksum: every datagram carries a CRC32C of its header fields
+// and payload, so a corrupted one is dropped on arrival and repaired like
+// a lost one, rather than reaching the file and failing the digest
+static inline uint32_t sham_checksum(const struct sham_header *h, const void *payload, uint32_t len) {
+    uint32_t crc = crc32c(0, h, offsetof(struct sham_header, checksum));
+    return crc32c(crc, payload, len);
+}
+
+// Stamp a header whose payload follows it or lies elsewhere
+static inline void sham_checksum_set(struct sham_header *h, const void *payload, uint32_t len) {
+    h->checksum = sham_checksum(h, payload, len);
+}
+
+static inline bool sham_checksum_ok(const struct sham_packet *pkt, uint32_t data_len) {
+    return pkt->header.checksum == sham_checksum(&pkt->header, pkt->data, data_len);
+}
+
+// SACK Block: a contiguous range [start_seq, end_seq) held by the receiver
+// above the cumulative ACK. An ACK with SHAM_SACK set carries up to
+// SHAM_MAX_SACK_BLOCKS of these as its payload, most recent first.
+struct sham_sack_block {
+    uint32_t start_seq;
+    uint32_t end_seq;
+} __attribute__((packed));
+
+// Parity Segment: with FEC on, the sender follows each block of data
+// segments with one whose payload is this header and the XOR of the
+// block's payloads, each zero-padded to the longest. Its seq_num is that
+// of the block's first segment; the others follow at multiples of the
+// segment size.
+struct sham_fec_header {
+    uint16_t count;        // Data segments in the block
+    uint16_t len_xor;      // XOR of their payload lengths
+    uint16_t flags_xor;    // XOR of their SHAM_COMPRESSED flags
 } __attribute__((packed));
 
-// Packet Window Entry (for tracking in-flight packets)
+#define SHAM_FEC_HEADER_SIZE sizeof(struct sham_fec_header)
+#define SHAM_FEC_MAX_MSS (SHAM_MAX_DATA_SIZE - SHAM_FEC_HEADER_SIZE)   // Largest segment whose parity fits a packet
+
+// Sender window entry: metadata only, the payload stays in the mapped file
 struct packet_window {
-    struct sham_packet packet;
+    struct sham_header header;
+    const uint8_t *data;   // Payload inside the input file mapping
     uint32_t data_len;
+    const uint8_t *payload;  // What goes on the wire: data, or its compressed block
+    uint32_t payload_len;
     struct timeval send_time;
+    struct timer rto_timer;  // Retransmission deadline, armed while unacknowledged
     int retries;
-    bool acked;
+    bool acked;            // Covered by a SACK block
+    bool fast_retx;        // Already resent for a SACK hole, dupACKs or a partial ACK
 };
 
 // Connection State
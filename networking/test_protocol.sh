@@ -164,6 +164,248 @@ for i in 1 2 3; do
 done
 echo ""
 
+# Test 5: Concurrent Clients
+echo -e "${YELLOW}Test 5: Four Concurrent Clients (--multi --workers=2, 5% loss)${NC}"
+dd if=/dev/urandom of=test5.bin bs=1M count=2 2>/dev/null
+rm -f received_file.*
+
+./server 8086 --multi --workers=2 0.05 > server_output5.txt 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+CLIENT_PIDS=""
+for i in 1 2 3 4; do
+    ./client 127.0.0.1 8086 test5.bin output5.bin > client_output5_$i.txt 2>&1 &
+    CLIENT_PIDS="$CLIENT_PIDS $!"
+done
+CLIENT_FAILURES=0
+for pid in $CLIENT_PIDS; do
+    wait $pid || CLIENT_FAILURES=$((CLIENT_FAILURES + 1))
+done
+kill -INT $SERVER_PID 2>/dev/null
+wait $SERVER_PID 2>/dev/null
+
+# Each connection writes its own received_file.<id>
+MATCHED=0
+for f in received_file.*; do
+    cmp -s test5.bin "$f" && MATCHED=$((MATCHED + 1))
+done
+grep "Connections completed" server_output5.txt
+if [ $MATCHED -eq 4 ] && [ $CLIENT_FAILURES -eq 0 ]; then
+    echo -e "${GREEN}✓ All 4 files received intact${NC}"
+else
+    echo -e "${RED}✗ $MATCHED of 4 files intact, $CLIENT_FAILURES clients failed${NC}"
+fi
+
+stop_server
+echo ""
+
+# Test 6: Delayed ACKs
+echo -e "${YELLOW}Test 6: Delayed ACKs (--ack-every=4 --ack-delay=10, 5% loss)${NC}"
+dd if=/dev/urandom of=test6.bin bs=1M count=1 2>/dev/null
+rm -f received_file
+
+./server 8087 --ack-every=4 --ack-delay=10 0.05 > server_output6.txt 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+./client 127.0.0.1 8087 test6.bin output6.bin > client_output6.txt 2>&1
+CLIENT_STATUS=$?
+wait $SERVER_PID 2>/dev/null
+
+grep "ACKs:" server_output6.txt
+SAVED=$(sed -n 's/.*(\([0-9]*\) saved.*/\1/p' server_output6.txt)
+if [ $CLIENT_STATUS -eq 0 ] && cmp -s test6.bin received_file && [ "${SAVED:-0}" -gt 0 ]; then
+    echo -e "${GREEN}✓ File received intact with fewer ACKs${NC}"
+else
+    echo -e "${RED}✗ Transfer failed or no ACKs were saved${NC}"
+fi
+
+stop_server
+echo ""
+
+# Test 7: Rate Cap
+echo -e "${YELLOW}Test 7: Paced Transfer (--rate=8 Mbit/s)${NC}"
+dd if=/dev/urandom of=test7.bin bs=1M count=1 2>/dev/null
+rm -f received_file
+
+./server 8088 > server_output7.txt 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+START_MS=$(date +%s%3N)
+./client 127.0.0.1 8088 test7.bin output7.bin --rate=8 > client_output7.txt 2>&1
+END_MS=$(date +%s%3N)
+wait $SERVER_PID 2>/dev/null
+
+# 1MB at 8 Mbit/s takes 1049ms; the bucket may lend a little at the start
+ELAPSED_MS=$((END_MS - START_MS))
+echo "Transfer time: ${ELAPSED_MS}ms (1049ms at the cap)"
+if cmp -s test7.bin received_file && [ $ELAPSED_MS -ge 950 ] && [ $ELAPSED_MS -le 1600 ]; then
+    echo -e "${GREEN}✓ File received intact at the capped rate${NC}"
+else
+    echo -e "${RED}✗ Transfer failed or did not keep to the rate${NC}"
+fi
+
+stop_server
+echo ""
+
+# Test 8: Parallel Streams
+echo -e "${YELLOW}Test 8: Parallel Streams (--streams=4, 2% loss)${NC}"
+dd if=/dev/urandom of=test8.bin bs=1M count=4 2>/dev/null
+rm -f received_file
+
+./server 8089 0.02 > server_output8.txt 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+./client 127.0.0.1 8089 test8.bin output8.bin --streams=4 > client_output8.txt 2>&1
+CLIENT_STATUS=$?
+wait $SERVER_PID 2>/dev/null
+
+grep "Parallel transfer" server_output8.txt
+if [ $CLIENT_STATUS -eq 0 ] && cmp -s test8.bin received_file; then
+    echo -e "${GREEN}✓ All streams reassembled into one intact file${NC}"
+else
+    echo -e "${RED}✗ Parallel transfer failed${NC}"
+fi
+
+stop_server
+echo ""
+
+# Test 9: Resume After an Interrupted Transfer
+echo -e "${YELLOW}Test 9: Resume a Killed Transfer (--resume)${NC}"
+dd if=/dev/urandom of=test9.bin bs=1M count=4 2>/dev/null
+rm -f received_file received_file.ckpt
+
+./server 8090 > server_output9.txt 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+# Kill the first attempt part way; the same server takes the second
+./client 127.0.0.1 8090 test9.bin output9.bin --resume --rate=8 > client_output9_1.txt 2>&1 &
+CLIENT_PID=$!
+sleep 1.5
+kill -9 $CLIENT_PID 2>/dev/null
+wait $CLIENT_PID 2>/dev/null
+
+./client 127.0.0.1 8090 test9.bin output9.bin --resume > client_output9_2.txt 2>&1
+CLIENT_STATUS=$?
+wait $SERVER_PID 2>/dev/null
+
+grep "Resuming" server_output9.txt
+if [ $CLIENT_STATUS -eq 0 ] && grep -q "Resuming" server_output9.txt && cmp -s test9.bin received_file; then
+    echo -e "${GREEN}✓ Transfer resumed and file received intact${NC}"
+else
+    echo -e "${RED}✗ Resumed transfer failed${NC}"
+fi
+
+stop_server
+echo ""
+
+# Test 10: Compression
+echo -e "${YELLOW}Test 10: Compressed Transfer (--compress=lz)${NC}"
+yes "S.H.A.M. compresses repetitive text like this line" | head -c 2097152 > test10.txt
+rm -f received_file
+
+./server 8092 0.02 > server_output10.txt 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+./client 127.0.0.1 8092 test10.txt output10.txt --compress=lz > client_output10.txt 2>&1
+CLIENT_STATUS=$?
+wait $SERVER_PID 2>/dev/null
+
+grep "Compression:" server_output10.txt
+if [ $CLIENT_STATUS -eq 0 ] && cmp -s test10.txt received_file && grep -q "Compression: LZ" server_output10.txt; then
+    echo -e "${GREEN}✓ Compressed file received intact${NC}"
+else
+    echo -e "${RED}✗ Compressed transfer failed${NC}"
+fi
+
+stop_server
+echo ""
+
+# Test 11: Forward Error Correction
+echo -e "${YELLOW}Test 11: FEC Under 5% Loss (--fec)${NC}"
+dd if=/dev/urandom of=test11.bin bs=1M count=4 2>/dev/null
+rm -f received_file
+
+./server 8093 0.05 > server_output11.txt 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+./client 127.0.0.1 8093 test11.bin output11.bin --fec > client_output11.txt 2>&1
+CLIENT_STATUS=$?
+wait $SERVER_PID 2>/dev/null
+
+grep "FEC:" server_output11.txt
+REBUILT=$(sed -n 's/.*FEC: \([0-9]*\) segments rebuilt.*/\1/p' server_output11.txt)
+if [ $CLIENT_STATUS -eq 0 ] && cmp -s test11.bin received_file && [ "${REBUILT:-0}" -gt 0 ]; then
+    echo -e "${GREEN}✓ File received intact, lost segments rebuilt from parity${NC}"
+else
+    echo -e "${RED}✗ FEC transfer failed or rebuilt nothing${NC}"
+fi
+
+stop_server
+echo ""
+
+# Test 12: Corrupted Segments
+echo -e "${YELLOW}Test 12: Corruption Through impair (--corrupt=0.02)${NC}"
+dd if=/dev/urandom of=test12.bin bs=1M count=2 2>/dev/null
+rm -f received_file
+
+./server 8094 > server_output12.txt 2>&1 &
+SERVER_PID=$!
+./impair 8095 127.0.0.1 8094 --corrupt=0.02 --seed=1 > impair_output12.txt 2>&1 &
+IMPAIR_PID=$!
+sleep 1
+
+./client 127.0.0.1 8095 test12.bin output12.bin > client_output12.txt 2>&1
+CLIENT_STATUS=$?
+wait $SERVER_PID 2>/dev/null
+kill -INT $IMPAIR_PID 2>/dev/null
+wait $IMPAIR_PID 2>/dev/null
+
+# Flipped bits are caught by the segment checksum at either end
+grep -h "Checksum errors" server_output12.txt client_output12.txt
+DROPPED=$(cat server_output12.txt client_output12.txt | sed -n 's/Checksum errors: \([0-9]*\).*/\1/p' | awk '{ n += $1 } END { print n + 0 }')
+if [ $CLIENT_STATUS -eq 0 ] && cmp -s test12.bin received_file && [ $DROPPED -gt 0 ]; then
+    echo -e "${GREEN}✓ Corrupted segments dropped and repaired${NC}"
+else
+    echo -e "${RED}✗ Corruption got through or the transfer failed${NC}"
+fi
+
+stop_server
+echo ""
+
+# Test 13: No Spurious Timeouts on a Clean Delayed Link
+echo -e "${YELLOW}Test 13: Clean Link with 20ms RTT (No Spurious Timeouts)${NC}"
+dd if=/dev/urandom of=test13.bin bs=1M count=1 2>/dev/null
+rm -f received_file
+
+./server 8096 > server_output13.txt 2>&1 &
+SERVER_PID=$!
+./impair 8097 127.0.0.1 8096 --delay=10 --jitter=1 > impair_output13.txt 2>&1 &
+IMPAIR_PID=$!
+sleep 1
+
+./client 127.0.0.1 8097 test13.bin output13.bin --mss=1024 > client_output13.txt 2>&1
+wait $SERVER_PID 2>/dev/null
+kill -INT $IMPAIR_PID 2>/dev/null
+wait $IMPAIR_PID 2>/dev/null
+
+# Nothing is lost on this link, so the RTO must never fire
+grep "Retransmissions:" client_output13.txt
+if cmp -s test13.bin received_file && grep -q "(timeout 0," client_output13.txt; then
+    echo -e "${GREEN}✓ Transfer completed without timeouts${NC}"
+else
+    echo -e "${RED}✗ Spurious timeouts or transfer failed${NC}"
+fi
+
+stop_server
+echo ""
+
 # Summary
 echo "======================================"
 echo "Test Summary"
@@ -176,8 +418,8 @@ echo "  - server_log.txt     : Server debug log (if RUDP_LOG=1)"
 echo "  - client_log.txt     : Client debug log (if RUDP_LOG=1)"
 echo ""
 echo "Cleanup test files with:"
-echo "  rm -f test*.txt test*.bin output*.txt output*.bin received_file"
-echo "  rm -f server_output*.txt client_output*.txt"
+echo "  rm -f test*.txt test*.bin output*.txt output*.bin received_file received_file.*"
+echo "  rm -f server_output*.txt client_output*.txt impair_output*.txt"
 echo "  rm -f server_log.txt client_log.txt"
 echo ""
 echo "======================================"
@@ -0,0 +1,194 @@
+#include <string.h>
+#include <time.h>
+#include "timer_wheel.h"
+
+#define TW_MASK (TW_SLOTS - 1)
+
+// Monotonic milliseconds
+uint64_t timer_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Same clock in microseconds
+uint64_t timer_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t now_ms) {
+    memset(w, 0, sizeof(*w));
+    w->now_ms = now_ms;
+}
+
+void timer_init(struct timer *t, timer_fn fn) {
+    t->next = NULL;
+    t->pprev = NULL;
+    t->expires_ms = 0;
+    t->fn = fn;
+}
+
+static void slot_push(struct timer_wheel *w, int level, int slot, struct timer *t) {
+    struct timer **head = &w->slots[level][slot];
+    t->next = *head;
+    if (*head) {
+        (*head)->pprev = &t->next;
+    }
+    *head = t;
+    t->pprev = head;
+    t->level = level;
+    t->slot = slot;
+    w->occupied[level] |= 1ULL << slot;
+}
+
+// File a timer by its distance from base, the earliest tick it may fire at
+static void place(struct timer_wheel *w, struct timer *t, uint64_t base) {
+    if (t->expires_ms < base) {
+        t->expires_ms = base;
+    }
+    uint64_t delta = t->expires_ms - w->now_ms;
+    if (delta > TW_MAX_DELAY_MS) {
+        t->expires_ms = w->now_ms + TW_MAX_DELAY_MS;
+        delta = TW_MAX_DELAY_MS;
+    }
+
+    int level = 0;
+    while (level < TW_LEVELS - 1 && delta >= 1ULL << ((level + 1) * TW_SLOT_BITS)) {
+        level++;
+    }
+    slot_push(w, level, (t->expires_ms >> (level * TW_SLOT_BITS)) & TW_MASK, t);
+}
+
+// Unlink without touching the count, clearing the slot bit if it empties
+static void unlink_timer(struct timer_wheel *w, struct timer *t) {
+    *t->pprev = t->next;
+    if (t->next) {
+        t->next->pprev = t->pprev;
+    }
+    if (w->slots[t->level][t->slot] == NULL) {
+        w->occupied[t->level] &= ~(1ULL << t->slot);
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+void timer_arm(struct timer_wheel *w, struct timer *t, uint64_t expires_ms) {
+    if (t->pprev) {
+        unlink_timer(w, t);
+    } else {
+        w->count++;
+    }
+    t->expires_ms = expires_ms;
+    place(w, t, w->now_ms + 1);
+}
+
+void timer_cancel(struct timer_wheel *w, struct timer *t) {
+    if (!t->pprev) return;
+    unlink_timer(w, t);
+    w->count--;
+}
+
+// Move the timers of one upper-level slot down to finer levels
+static void cascade(struct timer_wheel *w, int level) {
+    int slot = (w->now_ms >> (level * TW_SLOT_BITS)) & TW_MASK;
+    struct timer *t = w->slots[level][slot];
+    w->slots[level][slot] = NULL;
+    w->occupied[level] &= ~(1ULL << slot);
+
+    while (t) {
+        struct timer *next = t->next;
+        place(w, t, w->now_ms);
+        t = next;
+    }
+}
+
+// Next tick, after now_ms, with a level 0 timer or a cascade due
+static uint64_t next_tick(const struct timer_wheel *w) {
+    uint64_t boundary = (w->now_ms | TW_MASK) + 1;
+    uint64_t bits = w->occupied[0];
+    if (bits) {
+        int from = (w->now_ms + 1) & TW_MASK;
+        uint64_t rotated = from ? (bits >> from) | (bits << (TW_SLOTS - from)) : bits;
+        uint64_t tick = w->now_ms + 1 + __builtin_ctzll(rotated);
+        if (tick < boundary) {
+            return tick;
+        }
+    }
+    return boundary;
+}
+
+int timer_wheel_advance(struct timer_wheel *w, uint64_t now_ms, void *ctx) {
+    int fired = 0;
+
+    while (w->now_ms < now_ms) {
+        uint64_t tick = next_tick(w);
+        if (tick > now_ms) {
+            w->now_ms = now_ms;
+            break;
+        }
+        w->now_ms = tick;
+
+        // Crossing a level boundary pulls the next span down a level,
+        // coarsest first, so cascaded timers land in the right slot
+        if ((tick & TW_MASK) == 0) {
+            int top = 1;
+            while (top < TW_LEVELS - 1 && ((tick >> (top * TW_SLOT_BITS)) & TW_MASK) == 0) {
+                top++;
+            }
+            for (int level = top; level >= 1; level--) {
+                cascade(w, level);
+            }
+        }
+
+        // Pop one at a time: a callback may cancel a timer due in the same
+        // tick, and anything it re-arms lands in a later slot
+        int slot = tick & TW_MASK;
+        struct timer *t;
+        while ((t = w->slots[0][slot]) != NULL) {
+            unlink_timer(w, t);
+            w->count--;
+            fired++;
+            t->fn(t, ctx);
+        }
+    }
+    return fired;
+}
+
+uint64_t timer_wheel_next(const struct timer_wheel *w) {
+    if (w->count == 0) {
+        return UINT64_MAX;
+    }
+
+    uint64_t best = UINT64_MAX;
+    if (w->occupied[0]) {
+        int from = (w->now_ms + 1) & TW_MASK;
+        uint64_t bits = w->occupied[0];
+        uint64_t rotated = from ? (bits >> from) | (bits << (TW_SLOTS - from)) : bits;
+        best = w->now_ms + 1 + __builtin_ctzll(rotated);
+    }
+
+    // An upper slot first matters when it is cascaded, at the start of its span
+    for (int level = 1; level < TW_LEVELS; level++) {
+        uint64_t bits = w->occupied[level];
+        if (!bits) continue;
+        int shift = level * TW_SLOT_BITS;
+        uint64_t span = w->now_ms >> shift;
+        int from = (span + 1) & TW_MASK;
+        uint64_t rotated = from ? (bits >> from) | (bits << (TW_SLOTS - from)) : bits;
+        uint64_t tick = (span + 1 + __builtin_ctzll(rotated)) << shift;
+        if (tick < best) {
+            best = tick;
+        }
+    }
+    return best;
+}
+
+int timer_wheel_timeout(const struct timer_wheel *w, uint64_t now_ms, int max_ms) {
+    uint64_t next = timer_wheel_next(w);
+    if (next <= now_ms) {
+        return 0;
+    }
+    return next - now_ms < (uint64_t)max_ms ? (int)(next - now_ms) : max_ms;
+}
@@ -0,0 +1,78 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Timer Wheel Constants
+#define TW_LEVELS 4                // Wheels, each TW_SLOTS times coarser than the last
+#define TW_SLOT_BITS 6
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_MAX_DELAY_MS ((1ULL << (TW_LEVELS * TW_SLOT_BITS)) - 1)   // About 4.6 hours
+
+struct timer;
+
+// Expiry callback; ctx is whatever the caller passed to timer_wheel_advance()
+typedef void (*timer_fn)(struct timer *t, void *ctx);
+
+// Timer: embedded in the object it times and recovered with
+// TIMER_CONTAINER, so arming and cancelling never allocate
+struct timer {
+    struct timer *next;
+    struct timer **pprev;          // Link pointing at this timer; NULL when idle
+    uint64_t expires_ms;
+    timer_fn fn;
+    uint8_t level;                 // Where the timer is filed while armed
+    uint8_t slot;
+};
+
+#define TIMER_CONTAINER(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+// Hierarchical Timing Wheel with 1 ms ticks. Level 0 holds timers due in
+// the next TW_SLOTS ticks, one slot per tick; each higher level covers
+// TW_SLOTS times the span of the one below, and its slots are cascaded
+// down as the wheel turns. A bitmap per level marks non-empty slots, so
+// finding the next deadline never walks the timers themselves.
+struct timer_wheel {
+    uint64_t now_ms;               // Last tick processed
+    struct timer *slots[TW_LEVELS][TW_SLOTS];
+    uint64_t occupied[TW_LEVELS];
+    uint32_t count;                // Timers currently armed
+};
+
+// Monotonic clock in milliseconds, the time base for every wheel
+uint64_t timer_now_ms(void);
+
+// The same clock in microseconds, for rates finer than a tick
+uint64_t timer_now_us(void);
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t now_ms);
+
+void timer_init(struct timer *t, timer_fn fn);
+
+static inline bool timer_pending(const struct timer *t) {
+    return t->pprev != NULL;
+}
+
+// Arm (or re-arm) a timer for an absolute deadline; O(1). A deadline at or
+// before the current tick fires on the next advance.
+void timer_arm(struct timer_wheel *w, struct timer *t, uint64_t expires_ms);
+
+// Disarm a timer; O(1) and harmless if it is not armed
+void timer_cancel(struct timer_wheel *w, struct timer *t);
+
+// Run every timer due at or before now_ms; returns the number fired.
+// Callbacks may arm or cancel any timer, including their own.
+int timer_wheel_advance(struct timer_wheel *w, uint64_t now_ms, void *ctx);
+
+// Earliest tick at which the wheel has work: a timer expiry, or a cascade
+// that will bring one closer. UINT64_MAX when nothing is armed.
+uint64_t timer_wheel_next(const struct timer_wheel *w);
+
+// Milliseconds from now_ms until timer_wheel_next(), capped at max_ms,
+// for use as a poll() timeout
+int timer_wheel_timeout(const struct timer_wheel *w, uint64_t now_ms, int max_ms);
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "transfer.h"
+#include "writer.h"
+
+// Registry of transfers with at least one stream attached. Streams join
+// and leave only at handshake and close, so one lock is plenty.
+static struct transfer *registry = NULL;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct transfer *find_locked(uint32_t peer_ip, uint64_t id) {
+    for (struct transfer *t = registry; t; t = t->next) {
+        if (t->peer_ip == peer_ip && t->id == id) return t;
+    }
+    return NULL;
+}
+
+struct transfer *transfer_join(uint32_t peer_ip, const struct sham_stream_opt *opt,
+                               uint64_t range_size, digest_alg_t alg) {
+    if (opt->num_streams == 0 || opt->num_streams > SHAM_MAX_STREAMS ||
+        opt->index >= opt->num_streams || opt->offset > opt->total_size ||
+        range_size > opt->total_size - opt->offset) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    struct transfer *t = find_locked(peer_ip, opt->transfer_id);
+    if (t) {
+        if (t->total_size != opt->total_size || t->num_streams != opt->num_streams ||
+            t->digest_alg != alg) {
+            t = NULL;
+        }
+    } else if ((t = calloc(1, sizeof(*t))) != NULL) {
+        t->peer_ip = peer_ip;
+        t->id = opt->transfer_id;
+        t->total_size = opt->total_size;
+        t->num_streams = opt->num_streams;
+        t->digest_alg = alg;
+        t->fd = -1;
+        t->next = registry;
+        registry = t;
+    }
+    if (t) {
+        t->refs++;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return t;
+}
+
+bool transfer_active(uint32_t peer_ip, uint64_t id) {
+    pthread_mutex_lock(&registry_lock);
+    bool found = find_locked(peer_ip, id) != NULL;
+    pthread_mutex_unlock(&registry_lock);
+    return found;
+}
+
+int transfer_open(struct transfer *t, const char *filename) {
+    pthread_mutex_lock(&registry_lock);
+    if (t->fd < 0) {
+        snprintf(t->filename, sizeof(t->filename), "%s", filename);
+        t->fd = writer_create(t->filename, t->total_size, true);
+    }
+    int fd = t->fd;
+    pthread_mutex_unlock(&registry_lock);
+    return fd;
+}
+
+void transfer_range_done(struct transfer *t, uint16_t index, const uint8_t *digest,
+                         bool verified, uint64_t bytes) {
+    pthread_mutex_lock(&registry_lock);
+    if (!t->range_done[index]) {
+        t->range_done[index] = true;
+        memcpy(t->range_digests[index], digest, digest_length(t->digest_alg));
+        t->ranges_done++;
+        if (verified) t->ranges_verified++;
+        t->bytes += bytes;
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+bool transfer_leave(struct transfer *t) {
+    pthread_mutex_lock(&registry_lock);
+    bool last = --t->refs == 0;
+    if (last) {
+        struct transfer **link = &registry;
+        while (*link != t) link = &(*link)->next;
+        *link = t->next;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return last;
+}
+
+void transfer_free(struct transfer *t) {
+    if (t->fd >= 0) {
+        if (t->ranges_done == t->num_streams && ftruncate(t->fd, (off_t)t->total_size) < 0) {
+            perror("ftruncate");
+        }
+        close(t->fd);
+    }
+    free(t);
+}
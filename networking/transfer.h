@@ -0,0 +1,59 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sham.h"
+#include "options.h"
+#include "digest.h"
+
+// Parallel Transfer: a file the client sends as several ranges, each over
+// its own connection. The streams may land on different workers, so
+// transfers live in one registry shared by all of them, keyed by client
+// address and transfer id. Every stream writes its range into the one
+// output file at its own offset with pwrite; the transfer tracks which
+// ranges arrived whole and their digests, and is reported once the last
+// stream attached to it closes.
+struct transfer {
+    uint32_t peer_ip;              // Client address, network byte order
+    uint64_t id;
+    uint64_t total_size;
+    uint16_t num_streams;
+    digest_alg_t digest_alg;
+    char filename[64];
+    int fd;                        // Shared output file, -1 until a stream is established
+    uint32_t refs;                 // Connections attached
+
+    uint16_t ranges_done;          // Ranges received completely
+    uint16_t ranges_verified;      // ...whose digest matched the sender's
+    uint64_t bytes;                // Bytes written across all ranges
+    bool range_done[SHAM_MAX_STREAMS];
+    uint8_t range_digests[SHAM_MAX_STREAMS][DIGEST_MAX_LENGTH];
+
+    struct transfer *next;         // Registry chain
+};
+
+// Attach a stream, creating the transfer on its first one. NULL if the
+// range is malformed or disagrees with the streams already attached.
+struct transfer *transfer_join(uint32_t peer_ip, const struct sham_stream_opt *opt,
+                               uint64_t range_size, digest_alg_t alg);
+
+// Whether a stream of this transfer is already attached
+bool transfer_active(uint32_t peer_ip, uint64_t id);
+
+// Create the shared output file, unless another stream already has;
+// returns its descriptor
+int transfer_open(struct transfer *t, const char *filename);
+
+// Record a range that arrived whole, with its digest
+void transfer_range_done(struct transfer *t, uint16_t index, const uint8_t *digest,
+                         bool verified, uint64_t bytes);
+
+// Detach a stream. Returns true for the last one: the transfer has left
+// the registry, and the caller reports on it and frees it.
+bool transfer_leave(struct transfer *t);
+
+// Close the output file, trimmed to its full size, and free the transfer
+void transfer_free(struct transfer *t);
+
+#endif // TRANSFER_H
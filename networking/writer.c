@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "writer.h"
+
+// Create the output file and reserve its blocks up front
+int writer_create(const char *path, uint64_t expected_size, bool truncate) {
+    int fd = open(path, O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    if (fd < 0) {
+        perror("Failed to open output file");
+        return -1;
+    }
+
+    // Preallocation keeps the file contiguous and surfaces ENOSPC early;
+    // filesystems without fallocate support simply skip it
+    if (expected_size > 0) {
+#ifdef __linux__
+        if (fallocate(fd, 0, 0, (off_t)expected_size) < 0 && errno != EOPNOTSUPP) {
+            perror("fallocate");
+        }
+#else
+        posix_fallocate(fd, 0, (off_t)expected_size);
+#endif
+    }
+    return fd;
+}
+
+int writer_attach(struct file_writer *w, int fd, uint64_t base_offset) {
+    memset(w, 0, sizeof(*w));
+    w->fd = fd;
+    w->base_offset = base_offset;
+    w->buffer = malloc(WRITER_BUFFER_SIZE);
+    if (!w->buffer) {
+        w->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int writer_open(struct file_writer *w, const char *path, uint64_t expected_size, uint64_t resume_offset) {
+    int fd = writer_create(path, expected_size, resume_offset == 0);
+    if (fd < 0) {
+        memset(w, 0, sizeof(*w));
+        w->fd = -1;
+        return -1;
+    }
+    if (writer_attach(w, fd, resume_offset) < 0) {
+        close(fd);
+        return -1;
+    }
+    w->owns_fd = true;
+    return 0;
+}
+
+// Write out everything staged at its offset in the file
+int writer_flush(struct file_writer *w) {
+    uint32_t staged = (uint32_t)(w->committed - w->flushed);
+    uint32_t done = 0;
+
+    while (done < staged) {
+        ssize_t n = pwrite(w->fd, w->buffer + done, staged - done,
+                           (off_t)(w->base_offset + w->flushed + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (!w->error) {
+                w->error = errno;
+                perror("pwrite");
+            }
+            return -1;
+        }
+        done += n;
+        w->write_calls++;
+    }
+    w->flushed = w->committed;
+    return 0;
+}
+
+// Stage in-order data, flushing whenever the buffer fills
+int writer_append(struct file_writer *w, const struct iovec *iov, int iovcnt) {
+    for (int i = 0; i < iovcnt; i++) {
+        const uint8_t *data = iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+
+        while (len > 0) {
+            uint32_t staged = (uint32_t)(w->committed - w->flushed);
+            size_t room = WRITER_BUFFER_SIZE - staged;
+            size_t chunk = len < room ? len : room;
+
+            memcpy(w->buffer + staged, data, chunk);
+            w->committed += chunk;
+            data += chunk;
+            len -= chunk;
+
+            if (staged + chunk == WRITER_BUFFER_SIZE && writer_flush(w) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Flush, drop any preallocated tail that was never filled, and close. A
+// shared file belongs to whoever opened it and is left alone.
+int writer_close(struct file_writer *w) {
+    int ret = writer_flush(w);
+    if (w->fd >= 0 && w->owns_fd) {
+        if (ftruncate(w->fd, (off_t)(w->base_offset + w->committed)) < 0) {
+            perror("ftruncate");
+            ret = -1;
+        }
+        close(w->fd);
+    }
+    w->fd = -1;
+    free(w->buffer);
+    w->buffer = NULL;
+    return ret;
+}
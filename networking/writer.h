@@ -0,0 +1,49 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+// Writer Constants
+#define WRITER_BUFFER_SIZE (256 * 1024)   // In-order bytes staged per pwrite
+
+// File Writer: streams in-order data to its final offset in the output
+// file. Data is staged in a fixed buffer and written with one pwrite when
+// the buffer fills, so memory stays bounded whatever the file size.
+struct file_writer {
+    int fd;
+    uint64_t base_offset;          // File offset of the first byte of the stream
+    uint64_t committed;            // Bytes handed to the writer so far
+    uint64_t flushed;              // Bytes already written to the file
+    uint8_t *buffer;               // Staged bytes [flushed, committed)
+    uint32_t write_calls;
+    int error;                     // errno of the first failed write, or 0
+    bool owns_fd;                  // False when the file is shared with other writers
+};
+
+// Create a file, truncating it unless asked to keep its contents, and
+// preallocate expected_size bytes when known; returns the descriptor
+int writer_create(const char *path, uint64_t expected_size, bool truncate);
+
+// Create (or truncate) the output file, preallocating expected_size bytes
+// when known. A resumed transfer keeps the first resume_offset bytes from
+// an earlier run, and the stream is written after them.
+int writer_open(struct file_writer *w, const char *path, uint64_t expected_size, uint64_t resume_offset);
+
+// Write a stream into part of a file opened elsewhere, starting at
+// base_offset; closing the writer leaves the file open
+int writer_attach(struct file_writer *w, int fd, uint64_t base_offset);
+
+// Append in-order data; it lands at base_offset + committed
+int writer_append(struct file_writer *w, const struct iovec *iov, int iovcnt);
+
+// Write out everything staged
+int writer_flush(struct file_writer *w);
+
+// Flush, trim the file to what was committed and close it (only flush a
+// shared file)
+int writer_close(struct file_writer *w);
+
+#endif // WRITER_H